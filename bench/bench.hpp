@@ -0,0 +1,169 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "options.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace sdr
+{
+namespace bench
+{
+
+using Clock = std::chrono::steady_clock;
+
+inline double elapsed_ns(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+struct Stats {
+    std::size_t count = 0;
+    double mean = 0, min = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+};
+
+// Linear interpolation between closest ranks, samples must be sorted
+inline double percentile(std::vector<double> const& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+
+    double rank = p * (sorted.size() - 1);
+    auto lo = std::size_t(rank);
+    auto hi = std::min(lo + 1, sorted.size() - 1);
+
+    return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+inline Stats summarize(std::vector<double> samples) {
+    Stats s;
+
+    if (samples.empty())
+        return s;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (auto x: samples)
+        sum += x;
+
+    s.count = samples.size();
+    s.mean = sum / samples.size();
+    s.min = samples.front();
+    s.p50 = percentile(samples, 0.50);
+    s.p90 = percentile(samples, 0.90);
+    s.p99 = percentile(samples, 0.99);
+    s.max = samples.back();
+
+    return s;
+}
+
+struct Result {
+    std::string name;
+    double throughput;          // units per second
+    char const* unit;           // throughput unit
+    char const* latency_unit;   // unit of latency statistics
+    Stats latency;
+};
+
+enum Format {
+    Text,
+    Json
+};
+
+class Report {
+public:
+    explicit Report(Format fmt_, std::ostream& out_ = std::cout)
+        : fmt(fmt_), out(out_)
+        {}
+
+    ~Report() {
+        if (fmt == Json)
+            out << (first ? "[" : "\n") << "]" << std::endl;
+    }
+
+    void add(Result const& r) {
+        if (fmt == Json) {
+            out << (first ? "[\n" : ",\n") << std::setprecision(9)
+                << "  { \"name\": \"" << r.name << "\", "
+                << "\"throughput\": " << r.throughput << ", "
+                << "\"unit\": \"" << r.unit << "\", "
+                << "\"latency_unit\": \"" << r.latency_unit << "\", "
+                << "\"count\": " << r.latency.count << ", "
+                << "\"mean\": " << r.latency.mean << ", "
+                << "\"min\": " << r.latency.min << ", "
+                << "\"p50\": " << r.latency.p50 << ", "
+                << "\"p90\": " << r.latency.p90 << ", "
+                << "\"p99\": " << r.latency.p99 << ", "
+                << "\"max\": " << r.latency.max << " }";
+        } else {
+            if (first) {
+                out << std::left << std::setw(40) << "name" << std::right
+                    << std::setw(14) << "throughput" << "      "
+                    << std::setw(12) << "min"
+                    << std::setw(12) << "p50"
+                    << std::setw(12) << "p90"
+                    << std::setw(12) << "p99"
+                    << std::setw(12) << "max" << std::endl;
+            }
+
+            out << std::left << std::setw(40) << r.name << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(14) << scaled(r.throughput) << ' '
+                << std::left << std::setw(5) << unit_prefix(r.throughput) + r.unit << std::right
+                << std::setw(12) << r.latency.min
+                << std::setw(12) << r.latency.p50
+                << std::setw(12) << r.latency.p90
+                << std::setw(12) << r.latency.p99
+                << std::setw(12) << r.latency.max
+                << ' ' << r.latency_unit << std::endl;
+
+            out.unsetf(std::ios_base::floatfield);
+        }
+
+        first = false;
+    }
+
+private:
+    static double scaled(double v) {
+        return (v >= 1e9) ? v / 1e9 : (v >= 1e6) ? v / 1e6 : (v >= 1e3) ? v / 1e3 : v;
+    }
+
+    static std::string unit_prefix(double v) {
+        return (v >= 1e9) ? "G" : (v >= 1e6) ? "M" : (v >= 1e3) ? "k" : "";
+    }
+
+    Format fmt;
+    std::ostream& out;
+    bool first = true;
+};
+
+} /* namespace bench */
+} /* namespace sdr */
+
+template<>
+const opt::Option<sdr::bench::Format>::value_map opt::Option<sdr::bench::Format>::values = {
+    { "text", sdr::bench::Text },
+    { "json", sdr::bench::Json },
+};
@@ -0,0 +1,232 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.hpp"
+#include "hilbert.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace sdr;
+using namespace sdr::bench;
+
+enum Kernel {
+    Sine,
+    Cexp,
+    Fir,
+    FirReal,
+    Dft,
+    DftReal,
+    Widen,
+    Narrow,
+};
+
+template<>
+const opt::Option<Kernel>::value_map opt::Option<Kernel>::values = {
+    { "sine",     Sine    },
+    { "cexp",     Cexp    },
+    { "fir",      Fir     },
+    { "fir_real", FirReal },
+    { "dft",      Dft     },
+    { "dft_real", DftReal },
+    { "widen",    Widen   },
+    { "narrow",   Narrow  },
+};
+
+static char const* kernel_name(Kernel k) {
+    switch (k) {
+        case Sine:    return "sine";
+        case Cexp:    return "cexp";
+        case Fir:     return "fir";
+        case FirReal: return "fir_real";
+        case Dft:     return "dft";
+        case DftReal: return "dft_real";
+        case Widen:   return "widen";
+        case Narrow:  return "narrow";
+    }
+
+    return "";
+}
+
+// Every variant the library may be built with; the benchmark runs those
+// the host cpu supports, through the same dispatch tables as the blocks
+#if defined(CMT_ARCH_X86)
+static char const* const archs[] = { "sse2", "sse41", "avx", "avx2" };
+#else
+static char const* const archs[] = { "native" };
+#endif
+
+static std::size_t next_pow2(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+// Call fn in batches of iterations, return nanoseconds per sample for each batch
+static std::vector<double> measure(std::function<void()> const& fn, std::size_t samples,
+                                   std::uintmax_t warmup, std::uintmax_t repeat,
+                                   std::uintmax_t iterations) {
+    for (std::uintmax_t i = 0; i < warmup; ++i)
+        fn();
+
+    std::vector<double> result;
+    result.reserve(repeat);
+
+    for (std::uintmax_t r = 0; r < repeat; ++r) {
+        auto start = Clock::now();
+        for (std::uintmax_t i = 0; i < iterations; ++i)
+            fn();
+        auto end = Clock::now();
+
+        result.push_back(elapsed_ns(start, end) / (double(iterations) * samples));
+    }
+
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    Option<std::set<Kernel>> kernels("kernel",
+        { Sine, Cexp, Fir, FirReal, Dft, DftReal, Widen, Narrow });
+    Option<std::vector<std::uintmax_t>> sizes("sizes", Placeholder("SAMPLES,..."));
+    Option<std::uintmax_t> taps("taps", Placeholder("TAPS"), 127);
+    Option<std::uintmax_t> warmup("warmup", Placeholder("COUNT"), 100);
+    Option<std::uintmax_t> repeat("repeat", Placeholder("COUNT"), 200);
+    Option<std::uintmax_t> iterations("iterations", Placeholder("COUNT"), 20);
+    Option<Format> format("format", Text);
+
+    if (!opt::parse({}, { kernels, sizes, taps, warmup, repeat, iterations, format },
+                    argv, argv + argc))
+        return -1;
+
+    if (taps < 1 || repeat < 1 || iterations < 1) {
+        std::cerr << "error: bench-kernels: taps, repeat and iterations must be greater than zero"
+                  << std::endl;
+        return -1;
+    }
+
+    // Realistic sizes: what blocks emit for real and complex packets
+    std::vector<std::uintmax_t> block_sizes = sizes.get();
+    if (!sizes.is_set())
+        block_sizes = { optimal_block_size(sizeof(Sample)), optimal_block_size(sizeof(RealSample)) };
+
+    Report report(format);
+
+    for (auto arch: archs) {
+        auto table = kernels::find(arch);
+        if (!table) {
+            std::cerr << "warning: bench-kernels: host cpu does not support " << arch
+                      << ", skipping" << std::endl;
+            continue;
+        }
+
+        auto& k = *table;
+
+        for (auto kernel: kernels.get()) {
+            for (auto size: block_sizes) {
+                if (size < 1) {
+                    std::cerr << "error: bench-kernels: invalid size " << size << std::endl;
+                    return -1;
+                }
+
+                // DFT plans only support power-of-two sizes
+                std::size_t n = (kernel == Dft || kernel == DftReal) ? next_pow2(size) : size;
+
+                kfr::univector<RealSample> real_in(n), real_out(n);
+                kfr::univector<Sample> complex_in(n), complex_out(n);
+
+                for (std::size_t i = 0; i < n; ++i) {
+                    real_in[i] = RealSample(std::sin(2*M_PI*0.01*i));
+                    complex_in[i] = Sample(std::cos(2*M_PI*0.01*i), std::sin(2*M_PI*0.01*i));
+                }
+
+                auto real_inf = real_in.data();
+                auto real_outf = real_out.data();
+                auto complex_inf = reinterpret_cast<float const*>(complex_in.data());
+                auto complex_outf = reinterpret_cast<float*>(complex_out.data());
+
+                float phi = 0.0f;
+                const float cycles_per_sample = 0.0123f;
+
+                auto taps_data = hilbert<RealSample>(taps.get());
+
+                std::unique_ptr<kernels::Fir> fir;
+                std::unique_ptr<kernels::Dft> dft;
+
+                std::function<void()> fn;
+
+                switch (kernel) {
+                    case Sine:
+                        fn = [&]() {
+                            k.sine(real_outf, n, 1.0f, phi, cycles_per_sample);
+                            phi = phi + cycles_per_sample*n;
+                            phi -= std::floor(phi);
+                        };
+                        break;
+                    case Cexp:
+                        fn = [&]() {
+                            k.cexp(complex_outf, n, 1.0f, phi, cycles_per_sample);
+                            phi = phi + cycles_per_sample*n;
+                            phi -= std::floor(phi);
+                        };
+                        break;
+                    case Fir:
+                        fir = k.complex_fir(taps_data.data(), taps_data.size());
+                        fn = [&]() { fir->apply(complex_outf, complex_inf, n); };
+                        break;
+                    case FirReal:
+                        fir = k.fir(taps_data.data(), taps_data.size());
+                        fn = [&]() { fir->apply(real_outf, real_inf, n); };
+                        break;
+                    case Dft:
+                        dft = k.dft(n);
+                        fn = [&]() { dft->forward(complex_outf, complex_inf); };
+                        break;
+                    case DftReal:
+                        dft = k.real_dft(n);
+                        fn = [&]() { dft->forward(complex_outf, real_inf); };
+                        break;
+                    case Widen:
+                        fn = [&]() { k.widen(complex_outf, real_inf, n); };
+                        break;
+                    case Narrow:
+                        fn = [&]() { k.real(real_outf, complex_inf, n); };
+                        break;
+                }
+
+                auto stats = summarize(measure(fn, n, warmup, repeat, iterations));
+                double throughput = stats.mean > 0 ? 1e9 / stats.mean : 0;
+
+                report.add({ std::string("kernels/") + arch + "/" + kernel_name(kernel) + "/" +
+                                 std::to_string(n),
+                             throughput, "S/s", "ns/sample", stats });
+            }
+        }
+    }
+
+    return 0;
+}
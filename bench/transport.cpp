@@ -0,0 +1,334 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.hpp"
+#include "options.hpp"
+#include "stream.hpp"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace sdr;
+using namespace sdr::bench;
+
+enum Path {
+    Send,
+    Pass,
+    Copy,
+};
+
+template<>
+const opt::Option<Path>::value_map opt::Option<Path>::values = {
+    { "send", Send },
+    { "pass", Pass },
+    { "copy", Copy },
+};
+
+enum Kind {
+    Fifo,
+    Socket,
+    File,
+    Memfd,
+    Null,
+};
+
+template<>
+const opt::Option<Kind>::value_map opt::Option<Kind>::values = {
+    { "fifo",   Fifo   },
+    { "socket", Socket },
+    { "file",   File   },
+    { "memfd",  Memfd  },
+    { "null",   Null   },
+};
+
+static char const* path_name(Path p) {
+    switch (p) {
+        case Send: return "send";
+        case Pass: return "pass";
+        case Copy: return "copy";
+    }
+
+    return "";
+}
+
+static char const* kind_name(Kind k) {
+    switch (k) {
+        case Fifo:   return "fifo";
+        case Socket: return "socket";
+        case File:   return "file";
+        case Memfd:  return "memfd";
+        case Null:   return "null";
+    }
+
+    return "";
+}
+
+// A pair of file descriptors: the block side (used through Source/Sink)
+// and the peer side (fed or drained by a helper thread, -1 if not needed)
+struct Endpoint {
+    int fd = -1;
+    int peer = -1;
+
+    bool open(Kind kind, bool source) {
+        int fds[2];
+
+        switch (kind) {
+            case Fifo:
+                if (pipe(fds) < 0)
+                    return false;
+                fd = source ? fds[0] : fds[1];
+                peer = source ? fds[1] : fds[0];
+                return true;
+            case Socket:
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+                    return false;
+                fd = fds[0];
+                peer = fds[1];
+                return true;
+            case File: {
+                char const* dir = std::getenv("TMPDIR");
+                std::string name = std::string(dir ? dir : "/tmp") + "/sdr-bench-XXXXXX";
+                fd = mkstemp(&name[0]);
+                if (fd >= 0)
+                    unlink(name.c_str());
+                return fd >= 0;
+            }
+            case Memfd:
+                fd = memfd_create("sdr-bench", 0);
+                return fd >= 0;
+            case Null:
+                fd = ::open("/dev/null", source ? O_RDONLY : O_WRONLY);
+                return fd >= 0;
+        }
+
+        return false;
+    }
+
+    void close_peer() {
+        if (peer >= 0)
+            ::close(peer);
+        peer = -1;
+    }
+
+    void close() {
+        close_peer();
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+};
+
+static bool write_all(int fd, std::uint8_t const* data, std::size_t size) {
+    while (size) {
+        auto w = write(fd, data, size);
+        if (w <= 0)
+            return false;
+
+        data += w;
+        size -= w;
+    }
+
+    return true;
+}
+
+static void produce(int fd, std::vector<std::uint8_t> const* frame, std::uintmax_t count) {
+    while (count-- && write_all(fd, frame->data(), frame->size()));
+}
+
+static void drain(int fd, std::uintmax_t* total) {
+    std::vector<std::uint8_t> buf(1 << 20);
+
+    ssize_t r;
+    while ((r = read(fd, buf.data(), buf.size())) > 0)
+        *total += r;
+}
+
+// Run one configuration and return per-packet latencies in nanoseconds.
+// Sets delivered to the number of bytes that reached the sink, or to
+// expected when the sink cannot be inspected (/dev/null).
+static std::vector<double> run(Path path, Kind src_kind, Kind sink_kind,
+                               std::uint32_t size, std::uintmax_t warmup, std::uintmax_t count,
+                               std::uintmax_t& expected, std::uintmax_t& delivered) {
+    const Packet pkt = { 0, Packet::Binary, size, 0 };
+    const std::uintmax_t total = warmup + count;
+
+    std::vector<std::uint8_t> payload(size, 0x5a);
+    std::vector<std::uint8_t> frame(sizeof(Packet) + size, 0x5a);
+    *reinterpret_cast<Packet*>(frame.data()) = pkt;
+
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    expected = total * frame.size();
+    delivered = 0;
+
+    Endpoint src, dst;
+
+    if ((path != Send && !src.open(src_kind, true)) || !dst.open(sink_kind, false)) {
+        std::cerr << "error: bench-transport: cannot open endpoints" << std::endl;
+        src.close();
+        dst.close();
+        return latencies;
+    }
+
+    std::thread producer, drainer;
+
+    if (path != Send) {
+        if (src.peer >= 0) {
+            producer = std::thread(produce, src.peer, &frame, total);
+        } else {
+            for (std::uintmax_t i = 0; i < total; ++i)
+                write_all(src.fd, frame.data(), frame.size());
+            lseek(src.fd, 0, SEEK_SET);
+        }
+    }
+
+    if (dst.peer >= 0)
+        drainer = std::thread(drain, dst.peer, &delivered);
+
+    {
+        Source source(src.fd);
+        Sink sink(dst.fd);
+
+        for (std::uintmax_t i = 0; i < total; ++i) {
+            auto start = Clock::now();
+
+            if (path == Send) {
+                sink.send(pkt, payload);
+            } else {
+                if (!source.next())
+                    break;
+
+                if (path == Pass)
+                    source.pass(sink);
+                else
+                    source.copy(sink);
+            }
+
+            auto end = Clock::now();
+
+            if (i >= warmup)
+                latencies.push_back(elapsed_ns(start, end));
+        }
+    }
+
+    // Closing the block side unblocks helper threads
+    if (src.fd >= 0)
+        ::close(src.fd);
+    src.fd = -1;
+
+    if (sink_kind == File || sink_kind == Memfd) {
+        struct stat s{};
+        fstat(dst.fd, &s);
+        delivered = std::uintmax_t(s.st_size);
+    } else if (sink_kind == Null) {
+        delivered = expected;
+    }
+
+    ::close(dst.fd);
+    dst.fd = -1;
+
+    if (producer.joinable())
+        producer.join();
+    if (drainer.joinable())
+        drainer.join();
+
+    src.close();
+    dst.close();
+
+    return latencies;
+}
+
+int main(int argc, char* argv[]) {
+    Option<std::set<Path>> paths("path", { Send, Pass, Copy });
+    Option<std::set<Kind>> sources("source", { Fifo, Socket, File, Memfd });
+    Option<std::set<Kind>> sinks("sink", { Fifo, Socket, File, Memfd, Null });
+    Option<std::vector<std::uintmax_t>> sizes("sizes", Placeholder("BYTES,..."),
+        { 64, 256, 1024, 4096, 8160, 16384, 65536, 262144 });
+    Option<std::uintmax_t> packets("packets", Placeholder("COUNT"), 0);
+    Option<std::uintmax_t> warmup("warmup", Placeholder("COUNT"), 100);
+    Option<Format> format("format", Text);
+
+    if (!opt::parse({}, { paths, sources, sinks, sizes, packets, warmup, format },
+                    argv, argv + argc))
+        return -1;
+
+    if (sources.get().count(Null)) {
+        std::cerr << "error: bench-transport: null is not a valid source" << std::endl;
+        return -1;
+    }
+
+    for (auto size: sizes.get()) {
+        if (size < 1 || size > std::numeric_limits<std::uint32_t>::max()) {
+            std::cerr << "error: bench-transport: invalid packet size " << size << std::endl;
+            return -1;
+        }
+    }
+
+    // Helper threads may write to a closed pipe on failed runs
+    signal(SIGPIPE, SIG_IGN);
+
+    Report report(format);
+
+    for (auto path: paths.get()) {
+        for (auto src: (path == Send) ? std::set<Kind>{ Null } : sources.get()) {
+            for (auto dst: sinks.get()) {
+                for (auto size: sizes.get()) {
+                    // Default: about 32MiB of payload per run, within [100, 10000] packets
+                    auto count = packets.is_set() ? packets.get() :
+                        std::min(std::max((32ull << 20) / size, 100ull), 10000ull);
+
+                    std::string name = std::string("transport/") + path_name(path) + "/" +
+                        ((path == Send) ? "" : std::string(kind_name(src)) + "/") +
+                        kind_name(dst) + "/" + std::to_string(size);
+
+                    std::uintmax_t expected = 0, delivered = 0;
+                    auto latencies = run(path, src, dst, std::uint32_t(size),
+                                         warmup, count, expected, delivered);
+                    auto stats = summarize(latencies);
+
+                    double elapsed = stats.mean * stats.count;
+                    double throughput = elapsed > 0 ? (stats.count * size * 1e9) / elapsed : 0;
+
+                    if (latencies.size() < count || delivered < expected) {
+                        std::cerr << "warning: bench-transport: " << name << ": "
+                                  << delivered << " of " << expected << " bytes delivered"
+                                  << std::endl;
+                        throughput = 0;
+                    }
+
+                    report.add({ name, throughput, "B/s", "ns/packet", stats });
+                }
+            }
+        }
+    }
+
+    return 0;
+}
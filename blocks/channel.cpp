@@ -0,0 +1,218 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace sdr;
+
+// Samples per task; noise depends only on the sample index, so results
+// do not depend on how packets are split among threads
+static constexpr std::size_t chunk_size = 4096;
+
+// Phase noise draws from the same sequence as additive noise, this many
+// values further on
+static constexpr std::uint64_t walk_offset = std::uint64_t(1) << 62;
+
+// Box-Muller values stay within 5.9 deviations, so phase steps below this
+// deviation in cycles never wrap around
+static constexpr double max_walk_deviation = 0.08;
+
+struct Path {
+    std::size_t delay;
+    float re, im;
+};
+
+int main(int argc, char* argv[]) {
+    Option<float> noise("noise", Placeholder("DBFS"), 0.0f);
+    Option<double> offset("offset", Placeholder("FREQ"), 0.0);
+    FreqUnitNoStreamOption unit("unit", FreqUnit::Hertz);
+    Option<double> linewidth("linewidth", Placeholder("HERTZ"), 0.0);
+    Option<std::vector<double>> delays("delays", Placeholder("SAMPLES,..."), {});
+    Option<std::vector<double>> gains("gains", Placeholder("DB,..."), { 0.0 });
+    Option<std::vector<double>> phases("phases", Placeholder("PHASE,..."), { 0.0 });
+    Option<std::uintmax_t> sample_rate("sample_rate", Placeholder("HERTZ"), 0);
+    Option<std::uintmax_t> seed("seed", Placeholder("SEED"), 0);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({},
+                    { noise, offset, unit, linewidth, delays, gains, phases,
+                      sample_rate, seed, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: channel: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    if ((linewidth.is_set() || (offset.is_set() && unit.get() != FreqUnit::Samples)) &&
+        sample_rate == 0) {
+        std::cerr << "error: channel: option 'sample_rate' is required" << std::endl;
+        return -1;
+    }
+
+    // Wiener phase noise with a Lorentzian line of the given width
+    const double walk_deviation = linewidth.get() > 0.0
+        ? std::sqrt(linewidth.get()/(2*M_PI*double(sample_rate.get()))) : 0.0;
+
+    if (!(linewidth.get() >= 0.0) || walk_deviation > max_walk_deviation) {
+        std::cerr << "error: channel: linewidth must be between 0 and 4% of the sample rate"
+                  << std::endl;
+        return -1;
+    }
+
+    auto const& d = delays.get();
+    auto const& g = gains.get();
+    auto const& p = phases.get();
+
+    if ((g.size() != 1 && g.size() != d.size()) || (p.size() != 1 && p.size() != d.size())) {
+        std::cerr << "error: channel: gains and phases need one value or one per delay" << std::endl;
+        return -1;
+    }
+
+    std::vector<Path> paths;
+    std::size_t history = 0;
+
+    for (std::size_t i = 0; i < d.size(); ++i) {
+        if (!(d[i] >= 0.0 && d[i] <= 65536.0) || d[i] != std::floor(d[i])) {
+            std::cerr << "error: channel: delays must be whole samples between 0 and 65536"
+                      << std::endl;
+            return -1;
+        }
+
+        const auto gain = std::polar(std::pow(10.0, g[g.size() == 1 ? 0 : i]/20.0),
+                                     p[p.size() == 1 ? 0 : i]*M_PI/180.0);
+
+        paths.push_back({ std::size_t(d[i]), float(gain.real()), float(gain.imag()) });
+        history = std::max(history, std::size_t(d[i]));
+    }
+
+    // Noise power is the total of both components
+    const float deviation = noise.is_set() ? float(std::pow(10.0, noise.get()/20.0)/std::sqrt(2.0))
+                                           : 0.0f;
+
+    const std::uint64_t step = offset.is_set()
+        ? to_phase(convert_freq(unit.get(), offset.get(), sample_rate)) : 0;
+    const bool rotating = offset.is_set() || walk_deviation > 0.0;
+
+    const std::uint64_t key = seed.is_set() ? std::uint64_t(seed.get())
+                            : (std::uint64_t(std::random_device()()) << 32) ^ std::random_device()();
+
+    auto& k = kernels::active();
+
+    // Input history for the longest path, then the current packet
+    std::vector<Sample, SampleAllocator<Sample>> line(history);
+    std::vector<Sample, SampleAllocator<Sample>> scratch;
+    std::vector<RealSample, SampleAllocator<RealSample>> walk;
+    std::vector<std::uint64_t> turns;
+
+    // Samples processed so far, the counter of the noise generator
+    std::uint64_t position = 0;
+    std::uint64_t phase = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        // Real signals have no phase to impair and are passed through
+        if (pkt.id != id || pkt.content != Packet::ComplexSignal) {
+            source.pass(sink);
+            continue;
+        }
+
+        const std::size_t count = pkt.count<Sample>();
+        if (count == 0)
+            continue;
+
+        auto input = source.data<Sample>();
+        line.insert(line.end(), input, input + count);
+
+        scratch.resize(std::max(scratch.size(), count));
+        if (rotating) {
+            walk.resize(std::max(walk.size(), count));
+            turns.resize(std::max(turns.size(), count));
+        }
+
+        auto out = sink.buffer<Sample>(count);
+        auto outf = reinterpret_cast<float*>(out);
+        auto linef = reinterpret_cast<float const*>(line.data());
+        auto scratchf = reinterpret_cast<float*>(scratch.data());
+
+        // Multipath and phase steps, independent for every chunk
+        parallel_for(0, count, chunk_size, [&](std::size_t begin, std::size_t end) {
+            const std::size_t n = end - begin;
+
+            if (paths.empty()) {
+                std::copy_n(line.data() + begin, n, out + begin);
+            } else {
+                std::fill_n(out + begin, n, Sample(0.0f, 0.0f));
+                for (auto const& path : paths)
+                    k.multiply_accumulate(outf + 2*begin, linef + 2*(history + begin - path.delay),
+                                          n, path.re, path.im);
+            }
+
+            if (walk_deviation > 0.0)
+                k.gaussian(walk.data() + begin, n, float(walk_deviation), key,
+                           walk_offset + position + begin);
+        });
+
+        // The phase walk is a running sum, the only serial part
+        if (rotating) {
+            for (std::size_t i = 0; i < count; ++i) {
+                turns[i] = phase;
+                phase += step;
+                if (walk_deviation > 0.0)
+                    phase += std::uint64_t(std::int64_t(double(walk[i])*18446744073709551616.0));
+            }
+        }
+
+        parallel_for(0, count, chunk_size, [&](std::size_t begin, std::size_t end) {
+            const std::size_t n = end - begin;
+
+            if (rotating)
+                k.rotate(outf + 2*begin, outf + 2*begin, turns.data() + begin, n);
+
+            if (deviation > 0.0f) {
+                k.gaussian(scratchf + 2*begin, 2*n, deviation, key, 2*(position + begin));
+                k.accumulate(outf + 2*begin, scratchf + 2*begin, 2*n);
+            }
+        });
+
+        sink.commit({ pkt.id, Packet::ComplexSignal,
+                      std::uint32_t(count*sizeof(Sample)), pkt.duration });
+
+        position += count;
+        line.erase(line.begin(), line.begin() + count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/fir_design.hpp"
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+// Polyphase analysis filter bank. Channel k is centered on k*fs/M (upper
+// channels are negative frequencies) and is output as stream base + k at
+// fs/M, or 2*fs/M when oversampled.
+//
+// With the prototype taps reversed, weighting the last M*P input samples
+// and folding them into M sums turns every channel into a bin of a single
+// M point DFT, up to a per-channel phase rotation.
+int main(int argc, char* argv[]) {
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+    Option<std::uintmax_t> channels("channels", Placeholder("COUNT"), 8);
+    Option<std::uintmax_t> base("base", Placeholder("ID"), 0);
+    Option<std::set<std::uintmax_t>> enable("enable", Placeholder("CHANNEL,..."));
+    Option<std::uintmax_t> taps("taps", Placeholder("TAPS"), 16);
+    Option<float> beta("beta", Placeholder("VALUE"), 8.0f);
+    Option<bool> oversample("oversample", false);
+    Option<std::uintmax_t> batch("batch", Placeholder("SAMPLES"), 256);
+
+    if (!opt::parse({ id, channels }, { base, enable, taps, beta, oversample, batch },
+                    argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: channelize: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    const std::size_t m = channels;
+
+    if (m < 2 || (m & (m - 1)) || m > (std::size_t(1) << 16)) {
+        std::cerr << "error: channelize: channels must be a power of two between 2 and 2^16" << std::endl;
+        return -1;
+    }
+
+    const std::uintmax_t first = base.is_set() ? base.get() : id.get();
+
+    if (!valid_stream_id(first + m - 1)) {
+        std::cerr << "error: channelize: stream ids " << first << " to " << first + m - 1
+                  << " are not all valid" << std::endl;
+        return -1;
+    }
+
+    for (auto ch: enable.get()) {
+        if (ch >= m) {
+            std::cerr << "error: channelize: no channel " << ch << " among " << m << std::endl;
+            return -1;
+        }
+    }
+
+    if (taps < 1 || taps > 1024) {
+        std::cerr << "error: channelize: taps per channel must be between 1 and 1024" << std::endl;
+        return -1;
+    }
+
+    if (batch < 1 || batch > (std::uintmax_t(1) << 20)) {
+        std::cerr << "error: channelize: batch must be between 1 and 2^20 samples" << std::endl;
+        return -1;
+    }
+
+    const std::size_t decim = oversample ? m/2 : m;
+    const std::size_t length = m*taps;
+
+    std::vector<std::size_t> active;
+    for (std::size_t ch = 0; ch < m; ++ch) {
+        if (!enable.is_set() || enable.get().count(ch))
+            active.push_back(ch);
+    }
+
+    auto& k = kernels::active();
+    auto dft = k.dft(m);
+
+    // Prototype lowpass with unit DC gain, one channel wide, time reversed
+    std::vector<RealSample, SampleAllocator<RealSample>> proto(length);
+    {
+        kfr::univector<double> h(length);
+        auto window = kfr::window_kaiser<double>(length, beta.get());
+        kfr::fir_lowpass(h, 0.5/m, kfr::to_pointer(window));
+
+        std::transform(h.rbegin(), h.rend(), proto.begin(), [](double x) { return RealSample(x); });
+    }
+
+    // Folded sum index s carries polyphase branch M - 1 - s
+    std::vector<Sample> rotation(m);
+    for (std::size_t ch = 0; ch < m; ++ch) {
+        const double angle = -2*M_PI*ch/m;
+        rotation[ch] = Sample(std::cos(angle), std::sin(angle));
+    }
+
+    // Starts with enough zeros that the first output falls on the first
+    // full decimation period
+    std::vector<Sample, SampleAllocator<Sample>> line(length - decim);
+    std::vector<Sample, SampleAllocator<Sample>> weighted(length);
+    std::vector<Sample, SampleAllocator<Sample>> folded(m);
+    std::vector<Sample, SampleAllocator<Sample>> bins;
+
+    std::size_t pending = 0;
+    bool odd = false;
+
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    // Narrow channels would otherwise get a few samples per packet
+    auto flush = [&]() {
+        const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+        emitted += duration;
+
+        // With a hop of M/2 odd channels also flip sign every other output
+        for (auto ch: active) {
+            const Sample rot = rotation[ch];
+            const bool flip = oversample && (ch & 1);
+            auto out = sink.buffer<Sample>(pending);
+
+            for (std::size_t i = 0; i < pending; ++i) {
+                const bool negate = flip && (odd != bool(i & 1));
+                out[i] = (negate ? -rot : rot)*bins[i*m + ch];
+            }
+
+            sink.commit({ convert_stream_id(first + ch), Packet::ComplexSignal,
+                          std::uint32_t(pending*sizeof(Sample)), duration });
+        }
+
+        odd = odd != bool(pending & 1);
+        pending = 0;
+    };
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (pkt.id != id || pkt.content != Packet::ComplexSignal) {
+            source.pass(sink);
+            continue;
+        }
+
+        const std::size_t count = pkt.count<Sample>();
+        if (count == 0)
+            continue;
+
+        auto input = source.data<Sample>();
+        line.insert(line.end(), input, input + count);
+
+        if (line.size() < length)
+            continue;
+
+        const std::size_t outputs = (line.size() - length)/decim + 1;
+
+        bins.resize((pending + outputs)*m);
+
+        auto weighted_data = reinterpret_cast<float*>(weighted.data());
+        auto folded_data = reinterpret_cast<float*>(folded.data());
+
+        for (std::size_t i = 0; i < outputs; ++i) {
+            k.multiply_complex(weighted_data, reinterpret_cast<float const*>(line.data() + i*decim),
+                               proto.data(), length);
+
+            std::copy_n(weighted_data, 2*m, folded_data);
+            for (std::size_t p = 1; p < taps; ++p)
+                k.accumulate(folded_data, weighted_data + 2*p*m, 2*m);
+
+            dft->forward(reinterpret_cast<float*>(bins.data() + (pending + i)*m), folded_data);
+        }
+
+        line.erase(line.begin(), line.begin() + outputs*decim);
+
+        elapsed += outputs*decim*(double(pkt.duration)/count);
+        pending += outputs;
+
+        if (pending >= batch)
+            flush();
+    }
+
+    if (pending > 0)
+        flush();
+
+    return 0;
+}
@@ -0,0 +1,631 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "halfband.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace sdr;
+
+// Large factors are split into a chain: a CIC filter takes the bulk of the
+// decimation with a few integer additions per sample, half-band filters
+// halve the rate with a quarter of their taps each, and a final FIR
+// compensates the CIC droop and sets the output band.
+
+enum Format {
+    Float,
+    S8,
+    U8,
+    S16,
+    CS8,
+    CU8,
+    CS16
+};
+
+template<>
+const opt::Option<Format>::value_map opt::Option<Format>::values = {
+    { "float", Float },
+    { "s8",    S8    },
+    { "u8",    U8    },
+    { "s16",   S16   },
+    { "cs8",   CS8   },
+    { "cu8",   CU8   },
+    { "cs16",  CS16  },
+};
+
+static double kaiser_beta(double attenuation) {
+    if (attenuation > 50.0)
+        return 0.1102*(attenuation - 8.7);
+    if (attenuation > 21.0)
+        return 0.5842*std::pow(attenuation - 21.0, 0.4) + 0.07886*(attenuation - 21.0);
+    return 0.0;
+}
+
+// Kaiser estimate of the filter length for a transition width relative to
+// the sample rate
+static std::size_t kaiser_length(double attenuation, double transition) {
+    return std::size_t(std::ceil((attenuation - 7.95)/(14.36*transition))) + 1;
+}
+
+static std::vector<double> kaiser_window(std::size_t length, double beta) {
+    kfr::univector<double> w(length);
+    w = kfr::window_kaiser<double>(length, beta);
+    return std::vector<double>(w.begin(), w.end());
+}
+
+// Integer CIC decimator, one set of integrators and combs per channel.
+// Arithmetic wraps modulo 2^64, which is exact as long as the output
+// range fits.
+class Cic {
+public:
+    Cic(std::size_t factor, std::size_t order)
+        : factor(factor), order(order)
+        {}
+
+    void reset(std::size_t channels) {
+        width = channels;
+        integrators.assign(order*width, 0);
+        combs.assign(order*width, 0);
+        phase = 0;
+    }
+
+    // load(i) gives the i-th integer value of the interleaved input
+    template<typename Load>
+    std::size_t process(float* out, std::size_t count, double gain, Load load) {
+        std::size_t outputs = 0;
+
+        for (std::size_t i = 0; i < count; ++i) {
+            for (std::size_t c = 0; c < width; ++c) {
+                auto acc = integrators.data() + c*order;
+                std::uint64_t v = std::uint64_t(load(i*width + c));
+
+                for (std::size_t j = 0; j < order; ++j)
+                    v = acc[j] += v;
+            }
+
+            if (++phase < factor)
+                continue;
+
+            phase = 0;
+
+            for (std::size_t c = 0; c < width; ++c) {
+                auto prev = combs.data() + c*order;
+                std::uint64_t v = integrators[c*order + order - 1];
+
+                for (std::size_t j = 0; j < order; ++j) {
+                    const std::uint64_t t = v - prev[j];
+                    prev[j] = v;
+                    v = t;
+                }
+
+                out[outputs*width + c] = float(double(std::int64_t(v))*gain);
+            }
+
+            ++outputs;
+        }
+
+        return outputs;
+    }
+
+    const std::size_t factor;
+    const std::size_t order;
+
+private:
+    std::size_t width = 1;
+    std::size_t phase = 0;
+
+    std::vector<std::uint64_t> integrators, combs;
+};
+
+// Half-band decimator by two. Taps at even distances from the center are
+// zero but the center one (1/2): samples of one input phase only meet the
+// center tap and the others a dense filter with the remaining taps, so the
+// phases are split into separate lines and each output costs one dot
+// product of (length + 1)/2 taps plus a multiply-add for the center.
+class HalfBand {
+public:
+    // Length must be of the form 4*j + 3
+    HalfBand(std::size_t length, double beta)
+        : half(length/2), taps(half + 1)
+    {
+        // Symmetric, so time reversal is a no-op
+        auto h = halfband<double>(length, beta);
+        for (std::size_t j = 0; j <= half; ++j)
+            taps[j] = RealSample(h[2*j]);
+    }
+
+    std::size_t length() const noexcept {
+        return 2*half + 1;
+    }
+
+    void reset(std::size_t channels) {
+        width = channels;
+        dense.assign(half*width, 0.0f);
+        center.assign(((half - 1)/2)*width, 0.0f);
+        pending = false;
+    }
+
+    // Input pairs end on a dense sample; an unpaired one waits for the
+    // next call
+    std::size_t process(float* out, float const* in, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i, in += width) {
+            auto& line = pending ? dense : center;
+            line.insert(line.end(), in, in + width);
+            pending = !pending;
+        }
+
+        const std::size_t outputs = dense.size()/width - half;
+
+        for (std::size_t n = 0; n < outputs; ++n) {
+            auto window = dense.data() + n*width;
+            auto mid = center.data() + n*width;
+
+            if (width == 1) {
+                out[n] = k.dot(window, taps.data(), half + 1) + 0.5f*mid[0];
+            } else {
+                k.dot_complex(out + 2*n, window, taps.data(), half + 1);
+                out[2*n] += 0.5f*mid[0];
+                out[2*n + 1] += 0.5f*mid[1];
+            }
+        }
+
+        dense.erase(dense.begin(), dense.begin() + outputs*width);
+        center.erase(center.begin(), center.begin() + outputs*width);
+
+        return outputs;
+    }
+
+private:
+    kernels::Table const& k = kernels::active();
+
+    std::size_t half;
+    std::vector<RealSample, SampleAllocator<RealSample>> taps;
+
+    std::size_t width = 1;
+    bool pending = false;
+
+    std::vector<RealSample, SampleAllocator<RealSample>> dense, center;
+};
+
+// Decimating FIR flattening the passband of the CIC ahead of it. The
+// ideal response (inverse CIC droop up to the cutoff) is sampled on a
+// fine grid and windowed.
+class Compensator {
+public:
+    Compensator(std::size_t factor, std::size_t length, double cutoff, double beta,
+                std::size_t cic_factor, std::size_t cic_order, double cic_rate)
+        : factor(factor), taps(length)
+    {
+        auto window = kaiser_window(length, beta);
+
+        // Response of the CIC, f relative to the rate of this filter
+        auto droop = [&](double f) {
+            const double x = f/cic_rate;
+            if (cic_factor < 2 || x == 0.0)
+                return 1.0;
+            return std::pow(std::abs(std::sin(M_PI*x)/(cic_factor*std::sin(M_PI*x/cic_factor))),
+                            double(cic_order));
+        };
+
+        const std::size_t grid = 4096;
+        const double step = cutoff/grid;
+        const double mid = 0.5*(length - 1);
+
+        std::vector<double> h(length, 0.0);
+        for (std::size_t s = 0; s < grid; ++s) {
+            const double f = (s + 0.5)*step;
+            const double gain = 2.0*step/droop(f);
+
+            for (std::size_t j = 0; j < length; ++j)
+                h[j] += gain*std::cos(2*M_PI*f*(j - mid));
+        }
+
+        double sum = 0.0;
+        for (std::size_t j = 0; j < length; ++j)
+            sum += h[j] *= window[j];
+
+        // Symmetric, so time reversal is a no-op
+        for (std::size_t j = 0; j < length; ++j)
+            taps[j] = RealSample(h[j]/sum);
+    }
+
+    std::size_t length() const noexcept {
+        return taps.size();
+    }
+
+    void reset(std::size_t channels) {
+        width = channels;
+        line.assign((taps.size() - 1)*width, 0.0f);
+        phase = 0;
+    }
+
+    std::size_t process(float* out, float const* in, std::size_t count) {
+        line.insert(line.end(), in, in + count*width);
+
+        // Window ends on the sample each output is aligned to
+        const std::size_t available = line.size()/width - (taps.size() - 1);
+        const std::size_t outputs = phase < available ? (available - phase - 1)/factor + 1 : 0;
+
+        for (std::size_t n = 0; n < outputs; ++n) {
+            auto window = line.data() + (phase + n*factor)*width;
+
+            if (width == 1)
+                out[n] = k.dot(window, taps.data(), taps.size());
+            else
+                k.dot_complex(out + 2*n, window, taps.data(), taps.size());
+        }
+
+        phase = phase + outputs*factor - available;
+        line.erase(line.begin(), line.begin() + available*width);
+
+        return outputs;
+    }
+
+    const std::size_t factor;
+
+private:
+    kernels::Table const& k = kernels::active();
+
+    std::vector<RealSample, SampleAllocator<RealSample>> taps;
+
+    std::size_t width = 1;
+    std::size_t phase = 0;
+
+    std::vector<RealSample, SampleAllocator<RealSample>> line;
+};
+
+// Longest final FIR; the CIC takes any factor beyond, as long as it can
+// reject aliases well enough on its own
+static constexpr std::size_t max_fir_length = 4095;
+
+int main(int argc, char* argv[]) {
+    Option<std::uintmax_t> decimation("decimation", Placeholder("FACTOR"), Required);
+    Option<Format> format("format", Float);
+    Option<std::uintmax_t> order("order", Placeholder("STAGES"), 4);
+    Option<float> passband("passband", Placeholder("FRACTION"), 0.8f);
+    Option<float> attenuation("attenuation", Placeholder("DB"), 80.0f);
+    Option<bool> plan("plan", false);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ decimation, format },
+                    { order, passband, attenuation, plan, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!decimation.is_set()) {
+        std::cerr << "error: decimate: option 'decimation' is required" << std::endl;
+        opt::usage(argv[0],
+                   { decimation, format },
+                   { order, passband, attenuation, plan, id });
+        return -1;
+    }
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: decimate: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    const std::size_t total = decimation;
+
+    if (total < 2 || total > (std::size_t(1) << 24)) {
+        std::cerr << "error: decimate: decimation must be between 2 and 2^24" << std::endl;
+        return -1;
+    }
+
+    if (order < 1 || order > 8) {
+        std::cerr << "error: decimate: order must be between 1 and 8" << std::endl;
+        return -1;
+    }
+
+    if (!(passband > 0.0f && passband < 1.0f)) {
+        std::cerr << "error: decimate: passband must be in the range (0, 1)" << std::endl;
+        return -1;
+    }
+
+    if (!(attenuation >= 20.0f && attenuation <= 150.0f)) {
+        std::cerr << "error: decimate: attenuation must be between 20 and 150 dB" << std::endl;
+        return -1;
+    }
+
+    const double beta = kaiser_beta(attenuation);
+
+    // Passband edge relative to the output rate
+    const double edge = 0.5*passband;
+
+    // Band edges and length of a final FIR decimating by factor
+    auto fir_band = [&](std::size_t factor) {
+        const double pass = edge/factor;
+        const double stop = factor > 1 ? (1.0 - edge)/factor : 0.5;
+        return std::make_pair(pass, stop);
+    };
+    auto fir_taps = [&](std::size_t factor) {
+        auto band = fir_band(factor);
+        return kaiser_length(attenuation, band.second - band.first) | 1;
+    };
+
+    // Nothing after the CIC filters its aliases: the worst is the edge of
+    // the band, pass relative to the CIC output rate, folding over the
+    // first null
+    auto cic_rejection = [&](std::size_t factor, double pass) {
+        auto gain = [&](double x) {
+            return std::pow(std::abs(std::sin(M_PI*x)/(factor*std::sin(M_PI*x/factor))),
+                            double(order));
+        };
+        return -20*std::log10(gain(1.0 - pass)/gain(pass));
+    };
+
+    // Plan: the final FIR takes a factor of two when there is one, times
+    // the smallest odd factor that leaves the CIC enough alias rejection,
+    // as long as the filter fits in max_fir_length taps; half-bands take
+    // the remaining factors of two, up to three ahead of a CIC, and the
+    // CIC whatever is left.
+    std::size_t twos = 0;
+    while (!((total >> twos) & 1))
+        ++twos;
+
+    const std::size_t odd = total >> twos;
+
+    std::size_t fir_factor = 1;
+    std::size_t halfbands = 0;
+    std::size_t cic_factor = 1;
+    double rejection = 0.0;
+
+    for (std::size_t d = 1; d <= odd; ++d) {
+        const std::size_t factor = (twos ? 2 : 1)*d;
+        if (factor > 2 && fir_taps(factor) > max_fir_length)
+            break;
+
+        if (odd % d)
+            continue;
+
+        const std::size_t rest = total/factor;
+        std::size_t stages = twos ? twos - 1 : 0;
+        std::size_t cic = 1;
+
+        if (rest != (std::size_t(1) << stages) || stages > 4) {
+            stages = std::min<std::size_t>(stages, 3);
+            cic = rest >> stages;
+        }
+
+        fir_factor = factor;
+        halfbands = stages;
+        cic_factor = cic;
+
+        if (cic == 1)
+            break;
+
+        rejection = cic_rejection(cic, edge/factor/double(1 << stages));
+        if (rejection >= attenuation)
+            break;
+    }
+
+    const Format fmt = format.get();
+    const bool integer = fmt != Float;
+    const std::size_t input_bits = fmt == S16 || fmt == CS16 ? 16 : 8;
+    const std::size_t cic_order = cic_factor > 1 ? std::size_t(order) : 0;
+
+    // Bits of growth through the CIC
+    const std::size_t growth = std::size_t(std::ceil(cic_order*std::log2(double(cic_factor))));
+
+    if ((integer && input_bits + growth > 63) || (!integer && growth + 16 > 55)) {
+        std::cerr << "error: decimate: a cic decimation of " << cic_factor
+                  << " is too large for order " << order.get() << std::endl;
+        return -1;
+    }
+
+    if (cic_factor > 1 && rejection < attenuation) {
+        std::cerr << "error: decimate: a cic decimation of " << cic_factor << " and order "
+                  << order.get() << " rejects aliases by " << std::fixed << std::setprecision(1)
+                  << rejection << " dB, below the attenuation of " << attenuation.get()
+                  << " dB" << std::endl;
+        return -1;
+    }
+
+    // Float input is quantized with 7 bits of headroom above full scale
+    const std::size_t quant_bits = std::min<std::size_t>(63 - 8 - growth, 40);
+
+    std::vector<HalfBand> hbs;
+    for (std::size_t i = 0; i < halfbands; ++i) {
+        // Output rate of this stage relative to the final one
+        const double rate = double(fir_factor << (halfbands - 1 - i));
+        std::size_t length = kaiser_length(attenuation, 0.5 - edge/rate);
+        length = length/4*4 + 3;
+        hbs.emplace_back(length, beta);
+    }
+
+    const auto fir_edges = fir_band(fir_factor);
+
+    Compensator fir(fir_factor, fir_taps(fir_factor), 0.5*(fir_edges.first + fir_edges.second),
+                    beta, cic_factor, cic_order, double(1 << halfbands));
+
+    Cic cic(cic_factor, cic_order);
+
+    if (plan) {
+        double ops = 0.0;
+        std::size_t rate = 1;
+
+        std::cerr << std::fixed << std::setprecision(3);
+
+        if (cic_factor > 1) {
+            const double stage = cic_order*(1.0 + 1.0/cic_factor);
+            ops += stage;
+            rate = cic_factor;
+
+            std::cerr << "decimate: cic " << cic_factor << ", order " << cic_order
+                      << ", alias rejection " << std::setprecision(1) << rejection
+                      << " dB, " << std::setprecision(3) << stage << " ops/sample" << std::endl;
+        }
+
+        for (auto const& hb: hbs) {
+            const double stage = double((hb.length() + 1)/2 + 1)/(2*rate);
+            ops += stage;
+            rate *= 2;
+
+            std::cerr << "decimate: half-band 2, " << hb.length() << " taps, "
+                      << stage << " macs/sample" << std::endl;
+        }
+
+        const double stage = double(fir.length())/(rate*fir_factor);
+        ops += stage;
+
+        std::cerr << "decimate: fir " << fir_factor << ", " << fir.length() << " taps, "
+                  << stage << " macs/sample" << std::endl;
+        std::cerr << "decimate: " << total << " total, " << ops
+                  << " operations per input sample and channel" << std::endl;
+    }
+
+    // Scale of the integer values and full scale of integer formats
+    const double quant_scale = double(std::uint64_t(1) << quant_bits);
+    const double quant_limit = 128.0*quant_scale;
+    const double full_scale = input_bits == 16 ? 32768.0 : 128.0;
+    const std::int64_t offset = fmt == U8 || fmt == CU8 ? 128 : 0;
+    const double cic_gain = 1.0/(std::pow(double(cic_factor), double(cic_order)) *
+                                 (integer ? full_scale : quant_scale));
+
+    std::vector<RealSample, SampleAllocator<RealSample>> a, b;
+
+    bool initialized = false;
+    std::size_t channels = 1;
+
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        const bool accepted = integer ? pkt.content == Packet::Binary
+                                      : (pkt.content == Packet::Signal ||
+                                         pkt.content == Packet::ComplexSignal);
+
+        if (pkt.id != id || !accepted) {
+            source.pass(sink);
+            continue;
+        }
+
+        std::size_t width;
+        if (integer)
+            width = fmt == CS8 || fmt == CU8 || fmt == CS16 ? 2 : 1;
+        else
+            width = pkt.content == Packet::Signal ? 1 : 2;
+
+        const std::size_t sample_size = integer ? (input_bits/8)*width : sizeof(float)*width;
+        const std::size_t count = pkt.size/sample_size;
+
+        if (count == 0)
+            continue;
+
+        // Filter states never mix real and complex samples
+        if (!initialized || width != channels) {
+            initialized = true;
+            channels = width;
+
+            cic.reset(width);
+            for (auto& hb: hbs)
+                hb.reset(width);
+            fir.reset(width);
+        }
+
+        elapsed += double(pkt.duration);
+
+        // Ping-pong between two buffers, each stage at most keeps the size
+        a.resize(count*width + 2);
+        b.resize(count*width + 2);
+
+        float* cur = a.data();
+        float* next = b.data();
+        std::size_t n;
+
+        if (cic_factor > 1) {
+            if (fmt == Float) {
+                auto input = source.data<float>();
+                n = cic.process(cur, count, cic_gain, [&](std::size_t i) {
+                    const double x = std::max(-quant_limit,
+                                              std::min(quant_limit, double(input[i])*quant_scale));
+                    return std::int64_t(std::llrint(x));
+                });
+            } else if (input_bits == 16) {
+                auto input = source.data<std::int16_t>();
+                n = cic.process(cur, count, cic_gain, [&](std::size_t i) {
+                    return std::int64_t(input[i]);
+                });
+            } else if (offset) {
+                auto input = source.data<std::uint8_t>();
+                n = cic.process(cur, count, cic_gain, [&](std::size_t i) {
+                    return std::int64_t(input[i]) - offset;
+                });
+            } else {
+                auto input = source.data<std::int8_t>();
+                n = cic.process(cur, count, cic_gain, [&](std::size_t i) {
+                    return std::int64_t(input[i]);
+                });
+            }
+        } else {
+            n = count;
+
+            if (fmt == Float) {
+                std::copy_n(source.data<float>(), count*width, cur);
+            } else if (input_bits == 16) {
+                auto input = source.data<std::int16_t>();
+                for (std::size_t i = 0; i < count*width; ++i)
+                    cur[i] = float(input[i]/full_scale);
+            } else if (offset) {
+                auto input = source.data<std::uint8_t>();
+                for (std::size_t i = 0; i < count*width; ++i)
+                    cur[i] = float((std::int64_t(input[i]) - offset)/full_scale);
+            } else {
+                auto input = source.data<std::int8_t>();
+                for (std::size_t i = 0; i < count*width; ++i)
+                    cur[i] = float(input[i]/full_scale);
+            }
+        }
+
+        for (auto& hb: hbs) {
+            n = hb.process(next, cur, n);
+            std::swap(cur, next);
+        }
+
+        n = fir.process(next, cur, n);
+
+        if (n > 0) {
+            const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+            emitted += duration;
+
+            std::copy_n(next, n*width, sink.buffer<RealSample>(n*width));
+            sink.commit({ pkt.id, width == 1 ? Packet::Signal : Packet::ComplexSignal,
+                          std::uint32_t(n*width*sizeof(RealSample)), duration });
+        }
+    }
+
+    return 0;
+}
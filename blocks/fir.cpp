@@ -0,0 +1,233 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "fir_engine.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/fir_design.hpp"
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+using namespace sdr;
+
+enum Design {
+    Lowpass,
+    Highpass,
+    Bandpass,
+    Bandstop
+};
+
+template<>
+const opt::Option<Design>::value_map opt::Option<Design>::values = {
+    { "lowpass",  Lowpass  },
+    { "highpass", Highpass },
+    { "bandpass", Bandpass },
+    { "bandstop", Bandstop },
+};
+
+template<>
+const opt::Option<FirEngine>::value_map opt::Option<FirEngine>::values = {
+    { "auto",   FirEngine::Auto        },
+    { "direct", FirEngine::Direct      },
+    { "fft",    FirEngine::OverlapSave },
+};
+
+// Whitespace or comma separated numbers, # starts a comment
+static bool read_taps(std::string const& path, std::vector<RealSample>& taps) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string text;
+    for (std::string line; std::getline(file, line); ) {
+        text += line.substr(0, line.find('#'));
+        text += ' ';
+    }
+
+    std::replace(text.begin(), text.end(), ',', ' ');
+
+    std::istringstream stream(text);
+    taps.assign(std::istream_iterator<RealSample>(stream), std::istream_iterator<RealSample>());
+
+    return stream.eof();
+}
+
+int main(int argc, char* argv[]) {
+    Option<Design> design("type", Lowpass);
+    Option<float> low("low", Placeholder("FREQ"), 0.0f);
+    Option<float> high("high", Placeholder("FREQ"), 0.0f);
+    FreqUnitNoStreamOption unit("unit", FreqUnit::Hertz);
+    Option<std::uintmax_t> sample_rate("sample_rate", Placeholder("HERTZ"), 0);
+    Option<std::uintmax_t> taps("taps", Placeholder("TAPS"), 127);
+    Option<float> beta("beta", Placeholder("VALUE"), 6.0f);
+    Option<std::string> file("file", "");
+    Option<FirEngine> engine("engine", FirEngine::Auto);
+    Option<std::uintmax_t> size("size", Placeholder("POINTS"), 0);
+    Option<bool> delay("delay", true);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ design },
+                    { low, high, unit, sample_rate, taps, beta, file, engine, size, delay, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: fir: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    std::vector<RealSample> coeffs;
+
+    if (file.is_set()) {
+        if (!read_taps(file.get(), coeffs) || coeffs.empty()) {
+            std::cerr << "error: fir: cannot read taps from " << file.get() << std::endl;
+            return -1;
+        }
+    } else {
+        const FreqUnit freq_unit = unit.get();
+
+        if (freq_unit != FreqUnit::Samples && sample_rate == 0) {
+            std::cerr << "error: fir: option 'sample_rate' is required" << std::endl;
+            return -1;
+        }
+
+        const bool need_low = design != Lowpass, need_high = design != Highpass;
+
+        if ((need_low && !low.is_set()) || (need_high && !high.is_set())) {
+            std::cerr << "error: fir: " << (design == Lowpass ? "option 'high' is" :
+                                            design == Highpass ? "option 'low' is" :
+                                            "options 'low' and 'high' are")
+                      << " required" << std::endl;
+            return -1;
+        }
+
+        const float f1 = need_low ? convert_freq(freq_unit, low.get(), sample_rate) : 0.0f;
+        const float f2 = need_high ? convert_freq(freq_unit, high.get(), sample_rate) : 0.5f;
+
+        if (!(f1 >= 0.0f && f1 < f2 && f2 <= 0.5f) ||
+            (need_low && f1 == 0.0f) || (need_high && f2 == 0.5f)) {
+            std::cerr << "error: fir: band edges must lie between 0 and half the sample rate"
+                      << std::endl;
+            return -1;
+        }
+
+        if (taps < 3 || taps > (std::uintmax_t(1) << 16)) {
+            std::cerr << "error: fir: taps must be between 3 and 65536" << std::endl;
+            return -1;
+        }
+
+        // Highpass and bandstop designs need a tap at the center
+        if (!(taps & 1) && (design == Highpass || design == Bandstop)) {
+            std::cerr << "error: fir: " << (design == Highpass ? "highpass" : "bandstop")
+                      << " filters need an odd number of taps" << std::endl;
+            return -1;
+        }
+
+        kfr::univector<RealSample> h(taps);
+        auto window = kfr::window_kaiser<RealSample>(taps, beta.get());
+
+        switch (design.get()) {
+            case Lowpass:
+                kfr::fir_lowpass(h, f2, kfr::to_pointer(window));
+                break;
+            case Highpass:
+                kfr::fir_highpass(h, f1, kfr::to_pointer(window));
+                break;
+            case Bandpass:
+                kfr::fir_bandpass(h, f1, f2, kfr::to_pointer(window));
+                break;
+            case Bandstop:
+                kfr::fir_bandstop(h, f1, f2, kfr::to_pointer(window));
+                break;
+        }
+
+        coeffs.assign(h.begin(), h.end());
+    }
+
+    if (size.is_set() && (size <= coeffs.size() || (size & (size - 1)) ||
+                          size > (std::uintmax_t(1) << 24))) {
+        std::cerr << "error: fir: size must be a power of two above the number of taps"
+                  << std::endl;
+        return -1;
+    }
+
+    auto& k = kernels::active();
+
+    // Engines are picked on the first packet of each kind, once its size
+    // is known
+    std::unique_ptr<kernels::Fir> real_fir, complex_fir;
+    std::size_t fir_delay = delay ? (coeffs.size() - 1) / 2 : 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (pkt.id != id || (pkt.content != Packet::Signal &&
+                             pkt.content != Packet::ComplexSignal)) {
+            source.pass(sink);
+            continue;
+        }
+
+        const bool real = pkt.content == Packet::Signal;
+        const std::size_t width = real ? 1 : 2;
+        const std::size_t count = real ? pkt.count<RealSample>() : pkt.count<Sample>();
+
+        if (count == 0)
+            continue;
+
+        auto& fir = real ? real_fir : complex_fir;
+        if (!fir) {
+            fir = make_fir(k, coeffs.data(), coeffs.size(), !real, count,
+                           engine, std::size_t(size.get())).fir;
+        }
+
+        auto out = sink.buffer<float>(std::uint32_t(count*width));
+        fir->apply(out, source.data<float>(), count);
+
+        std::size_t skip = std::min(count, fir_delay);
+
+        if (skip > 0) {
+            fir_delay -= skip;
+
+            pkt.size -= skip*width*sizeof(float);
+            pkt.duration -= (skip*pkt.duration)/count;
+
+            if (pkt.size == 0)
+                continue;
+
+            std::copy(out + skip*width, out + count*width, out);
+        }
+
+        sink.commit(pkt);
+    }
+
+    return 0;
+}
@@ -16,14 +16,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "hilbert.hpp"
+#include "async.hpp"
+#include "kernels.hpp"
 #include "options.hpp"
 #include "signal.hpp"
 #include "stream.hpp"
 
-#include "kfr/dsp/oscillators.hpp"
-
 #include <atomic>
+#include <cmath>
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -58,6 +58,188 @@ const opt::Option<Mode>::value_map opt::Option<Mode>::values = {
     { "complex", Complex },
 };
 
+// How Signal packets on the frequency stream drive the output: not at
+// all, as instantaneous frequency or as phase, one output per sample
+enum Control {
+    Message,
+    FrequencyControl,
+    PhaseControl
+};
+
+template<>
+const opt::Option<Control>::value_map opt::Option<Control>::values = {
+    { "message",   Message          },
+    { "frequency", FrequencyControl },
+    { "phase",     PhaseControl     },
+};
+
+template<>
+const opt::Option<kernels::Oscillator>::value_map opt::Option<kernels::Oscillator>::values = {
+    { "polynomial", kernels::Polynomial },
+    { "lookup",     kernels::Lookup     },
+    { "rotation",   kernels::Rotation   },
+};
+
+static float to_cycles(std::uint64_t phase) {
+    return float(std::ldexp(double(phase), -64));
+}
+
+// Smallest q up to limit such that p/q is within tolerance of the
+// fractional part of cycles, by continued fractions; 0 when there is none
+static std::uint64_t rational_period(double cycles, double tolerance,
+                                     std::uint64_t limit, std::uint64_t& p) {
+    const double x = cycles - std::floor(cycles);
+
+    // Convergents h/k
+    double h0 = 0.0, h1 = 1.0, k0 = 1.0, k1 = 0.0;
+    double rest = x;
+
+    while (k0 <= double(limit)) {
+        if (std::fabs(x - h0/k0) <= tolerance) {
+            p = std::uint64_t(h0) % std::uint64_t(k0);
+            return std::uint64_t(k0);
+        }
+
+        if (rest - std::floor(rest) < 1e-12)
+            break;
+
+        rest = 1.0/(rest - std::floor(rest));
+        const double a = std::floor(rest);
+
+        const double h = a*h0 + h1, k = a*k0 + k1;
+        h1 = h0; k1 = k0;
+        h0 = h; k0 = k;
+    }
+
+    return 0;
+}
+
+// Harmonics of a wave strictly below Nyquist, as many as the largest
+// table can resolve for very low frequencies
+static constexpr std::size_t max_harmonics = std::size_t(1) << 13;
+
+static std::size_t harmonic_count(double cycles) {
+    const double c = std::fabs(cycles - std::round(cycles));
+    if (c*max_harmonics < 0.5)
+        return max_harmonics;
+
+    return std::size_t(std::ceil(0.5/c) - 1.0);
+}
+
+// One cycle of a band-limited analytic square, triangle or sawtooth, from
+// the Fourier series of the kfr waves: each sin(h*x) term becomes
+// -j*exp(j*h*x). Tables hold at least 256 values per cycle of the top
+// harmonic, for linear interpolation; returns the log2 of the size.
+static unsigned analytic_table(Waveform waveform, std::size_t harmonics,
+                               kernels::Table const& k,
+                               std::vector<Sample, SampleAllocator<Sample>>& table) {
+    unsigned bits = 12;
+    while (bits < 21 && (std::size_t(1) << bits) < 256*harmonics)
+        ++bits;
+
+    const std::size_t n = std::size_t(1) << bits;
+
+    std::vector<Sample, SampleAllocator<Sample>> spectrum(n, Sample(0.0f, 0.0f));
+    for (std::size_t h = 1; h <= harmonics; ++h) {
+        double a = 0.0;
+
+        switch (waveform) {
+            case Square:
+                a = (h & 1) ? 4.0/(M_PI*h) : 0.0;
+                break;
+            case Triangle:
+                a = (h & 1) ? ((h & 2) ? -8.0 : 8.0)/(M_PI*M_PI*h*h) : 0.0;
+                break;
+            case Sawtooth:
+                a = 2.0/(M_PI*h);
+                break;
+            default:
+                break;
+        }
+
+        spectrum[h] = Sample(0.0f, float(-a));
+    }
+
+    table.resize(n + 1);
+    k.dft(n)->inverse(reinterpret_cast<float*>(table.data()),
+                      reinterpret_cast<float const*>(spectrum.data()));
+    table[n] = table[0];
+
+    return bits;
+}
+
+// Cycles as an accumulator offset, wrapped to [-0.5, 0.5)
+static std::uint64_t to_offset(double cycles) {
+    return std::uint64_t(std::int64_t(std::ldexp(cycles - std::floor(cycles + 0.5), 64)));
+}
+
+// Frequency or phase modulation by the Signal packets of the control
+// stream: each control sample times gain is added to the carrier, in
+// hertz or radians, and yields one output sample. Frequency messages on
+// the same stream set the carrier.
+static int modulate(std::uint16_t id, std::uint16_t control_id, Control control,
+                    bool real, float amp, std::uint64_t phase, double gain,
+                    std::uintmax_t sample_rate) {
+    auto& k = kernels::active();
+
+    std::uint64_t step = 0;
+    std::vector<std::uint64_t> phases;
+
+    // Control samples in cycles per sample or cycles
+    const double scale = control == FrequencyControl ? gain/double(sample_rate) : gain/(2*M_PI);
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (pkt.id != control_id)
+            continue;
+
+        auto unit = content_to_unit<FreqUnit>(pkt.content);
+        if (unit != FreqUnit::Stream) {
+            if (pkt.count<float>())
+                step = to_phase(convert_freq<double>(unit, source.data<float>()[0], sample_rate));
+            continue;
+        }
+
+        if (pkt.content != Packet::Signal || pkt.count<RealSample>() == 0)
+            continue;
+
+        const std::size_t count = pkt.count<RealSample>();
+        auto input = source.data<RealSample>();
+
+        phases.resize(std::max(phases.size(), count));
+
+        // The accumulator is a running sum, the rest is vectorized
+        if (control == FrequencyControl) {
+            for (std::size_t i = 0; i < count; ++i) {
+                phases[i] = phase;
+                phase += step + to_offset(scale*input[i]);
+            }
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                phases[i] = phase + to_offset(scale*input[i]);
+                phase += step;
+            }
+        }
+
+        if (real) {
+            k.modulate(sink.buffer<RealSample>(count), phases.data(), count, amp);
+            sink.commit({ id, Packet::Signal, std::uint32_t(count*sizeof(RealSample)),
+                          pkt.duration });
+        } else {
+            k.complex_modulate(reinterpret_cast<float*>(sink.buffer<Sample>(count)),
+                               phases.data(), count, amp);
+            sink.commit({ id, Packet::ComplexSignal, std::uint32_t(count*sizeof(Sample)),
+                          pkt.duration });
+        }
+    }
+
+    return 0;
+}
+
 static std::atomic<float> freq_msg(0.0f);
 static std::atomic<bool> source_end(false);
 static std::atomic<bool> freq_msg_set(false);
@@ -88,11 +270,16 @@ int main(int argc, char* argv[]) {
     Option<float> amplitude("amp", Placeholder("AMPLITUDE"), 1.0f);
     Option<float> phase("phi", Placeholder("PHASE"), 0.0f);
     Option<Mode> mode("mode", Complex);
-    Option<std::uintmax_t> hilbert_taps("hilbert_taps", Placeholder("COUNT"), 127);
+    Option<Control> control("control", Message);
+    Option<double> gain("gain", Placeholder("VALUE"), 1.0);
+    Option<kernels::Oscillator> oscillator("oscillator", kernels::Polynomial);
+    Option<std::uintmax_t> phase_bits("phase_bits", Placeholder("BITS"), 64);
+    Option<std::uintmax_t> period_cache("period_cache", Placeholder("SAMPLES"), 1 << 20);
     Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
 
     if (!opt::parse({ freq, unit, waveform },
-                    { sample_rate, amplitude, phase, mode, hilbert_taps, id },
+                    { sample_rate, amplitude, phase, mode, control, gain,
+                      oscillator, phase_bits, period_cache, id },
                     argv, argv + argc))
         return -1;
 
@@ -100,7 +287,8 @@ int main(int argc, char* argv[]) {
         std::cerr << "error: gen: options 'freq' and 'sample_rate' are required" << std::endl;
         opt::usage(argv[0],
                    { freq, unit, waveform },
-                   { sample_rate, amplitude, phase, mode, hilbert_taps, id });
+                   { sample_rate, amplitude, phase, mode, control, gain,
+                     oscillator, phase_bits, period_cache, id });
         return -1;
     }
 
@@ -114,14 +302,43 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    if (phase_bits != 32 && phase_bits != 64) {
+        std::cerr << "error: gen: phase_bits must be 32 or 64" << std::endl;
+        return -1;
+    }
+
+    if (control != Message && unit != FreqUnit::Stream) {
+        std::cerr << "error: gen: frequency and phase control need unit=stream" << std::endl;
+        return -1;
+    }
+
+    if (control != Message && waveform != Cosine && waveform != Sine) {
+        std::cerr << "error: gen: frequency and phase control need a cosine or sine waveform"
+                  << std::endl;
+        return -1;
+    }
+
+    // Oscillators produce cosines, sin(x) = cos(x - pi/2)
+    const std::uint64_t osc_phase = waveform == Sine ? -(std::uint64_t(1) << 62) : 0;
+
+    if (control != Message)
+        return modulate(std::uint16_t(id), convert_stream_id(freq.get()), control,
+                        mode == Real, amplitude, to_phase(phase / 360.0) + osc_phase,
+                        gain, sample_rate);
+
     const std::size_t block_size =
         optimal_block_size((mode == Real) ? sizeof(RealSample) : sizeof(Sample), sample_rate);
 
     const float A = amplitude;
 
-    float cycles_per_sample = convert_freq(unit, freq.get(), sample_rate);
-    float phi = kfr::fract(phase / 360.0f);
-    float phi_incr = kfr::fract(cycles_per_sample * block_size);
+    const unsigned bits = unsigned(phase_bits.get());
+
+    // Integer phase accumulator, exact over any run length; the step is
+    // worked out in double precision from the option
+    const double exact_cycles = convert_freq(unit, double(freq.get()), sample_rate);
+    float cycles_per_sample = float(exact_cycles);
+    std::uint64_t acc = to_phase(phase / 360.0, 64);
+    std::uint64_t step = to_phase(exact_cycles, bits);
 
     Sink sink;
 
@@ -134,9 +351,42 @@ int main(int argc, char* argv[]) {
     std::vector<RealSample, SampleAllocator<RealSample>> real_data(mode == Real ? block_size : 0);
     std::vector<Sample, SampleAllocator<Sample>> complex_data(mode == Complex ? block_size : 0);
 
-    const Sample j2pi = { 0, kfr::constants<RealSample>::pi_s(2) };
-    kfr::fir_state<RealSample> hilb(hilbert<RealSample>(hilbert_taps.get()));
-    const auto hilb_delay = (hilbert_taps - 1) / 2;
+    auto& k = kernels::active();
+
+    const bool analytic = mode == Complex && waveform != Cosine && waveform != Sine;
+
+    // Analytic non-sinusoidal waves are read from a band-limited table,
+    // rebuilt when the number of harmonics below Nyquist changes
+    std::vector<Sample, SampleAllocator<Sample>> table;
+    std::size_t harmonics = 0;
+    unsigned table_bits = 0;
+
+    if (analytic) {
+        harmonics = harmonic_count(exact_cycles);
+        table_bits = analytic_table(waveform, harmonics, k, table);
+    }
+
+    const bool sinusoid = waveform == Cosine || waveform == Sine;
+
+    auto osc = k.oscillator[oscillator.get()];
+    auto complex_osc = k.complex_oscillator[oscillator.get()];
+
+    void (*wave)(float*, std::size_t, float, float, float) = nullptr;
+
+    switch (waveform.get()) {
+        case Cosine:
+        case Sine:
+            break;
+        case Square:
+            wave = k.square;
+            break;
+        case Triangle:
+            wave = k.triangle;
+            break;
+        case Sawtooth:
+            wave = k.sawtooth;
+            break;
+    }
 
     const bool no_source = unit != FreqUnit::Stream;
 
@@ -145,22 +395,49 @@ int main(int argc, char* argv[]) {
         thr.detach();
     }
 
-    if (mode == Complex && no_source) {
-        kfr::univector<Sample> discard(hilb_delay);
+    // A constant frequency of p/q cycles per sample repeats every q samples.
+    // The 32-bit accumulator is left alone, its rounding is deliberate.
+    std::uint64_t period = 0;
+    if (no_source && bits == 64 && period_cache > 0) {
+        std::uint64_t p = 0;
+        const double tolerance = std::ldexp(std::fabs(exact_cycles), -48);
+        period = rational_period(exact_cycles, tolerance, period_cache, p);
 
-        switch (waveform.get()) {
-            case Square:
-                discard = kfr::fir(hilb, kfr::squarenorm(phi + cycles_per_sample*kfr::counter()));
-                break;
-            case Triangle:
-                discard = kfr::fir(hilb, kfr::trianglenorm(phi + cycles_per_sample*kfr::counter()));
-                break;
-            case Sawtooth:
-                discard = kfr::fir(hilb, kfr::sawtoothnorm(phi + cycles_per_sample*kfr::counter()));
-                break;
-            default:
-                break;
+        if (period)
+            step = to_phase(double(p)/double(period), 64);
+    }
+
+    // Fills a block at the accumulator phase, then advances it
+    auto generate = [&](float* out) {
+        if (mode == Real) {
+            if (sinusoid)
+                osc(out, block_size, A, acc + osc_phase, step);
+            else
+                wave(out, block_size, A, to_cycles(acc), cycles_per_sample);
+        } else if (!analytic) {
+            complex_osc(out, block_size, A, acc + osc_phase, step);
+        } else {
+            k.complex_wavetable(out, block_size, reinterpret_cast<float const*>(table.data()),
+                                table_bits, A, acc, step);
         }
+
+        acc += step*block_size;
+    };
+
+    auto data = (mode == Real) ? real_data.data() : reinterpret_cast<float*>(complex_data.data());
+
+    if (period) {
+        const std::size_t width = (mode == Real) ? 1 : 2;
+
+        // One period plus a block, so that every block is a single slice
+        const std::size_t blocks = (period + 2*block_size - 1)/block_size;
+        std::vector<RealSample, SampleAllocator<RealSample>> cache(blocks*block_size*width);
+
+        for (std::size_t i = 0; i < blocks; ++i)
+            generate(cache.data() + i*block_size*width);
+
+        for (std::size_t offset = 0;; offset = (offset + block_size) % period)
+            sink.send_shared(pkt, cache.data() + offset*width);
     }
 
     for (;;) {
@@ -171,97 +448,19 @@ int main(int argc, char* argv[]) {
             float msg = freq_msg.load(std::memory_order_relaxed);
             if (msg != cycles_per_sample) {
                 cycles_per_sample = msg;
-                phi_incr = kfr::fract(cycles_per_sample * block_size);
-            }
-        }
+                step = to_phase(cycles_per_sample, bits);
 
-        if (mode == Real) {
-            kfr::univector<RealSample, 0> block(real_data.data(), block_size);
-
-            switch (waveform.get()) {
-                case Cosine:
-                    do {
-                        block = A*kfr::sinenorm(phi + 0.25f + cycles_per_sample*kfr::counter());
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, real_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Sine:
-                    do {
-                        block = A*kfr::sinenorm(phi + cycles_per_sample*kfr::counter());
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, real_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Square:
-                    do {
-                        block = A*kfr::squarenorm(phi + cycles_per_sample*kfr::counter());
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, real_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Triangle:
-                    do {
-                        block = A*kfr::trianglenorm(phi + cycles_per_sample*kfr::counter());
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, real_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Sawtooth:
-                    do {
-                        block = A*kfr::sawtoothnorm(phi + cycles_per_sample*kfr::counter());
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, real_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-            }
-        } else {
-            kfr::univector<Sample, 0> block(complex_data.data(), block_size);
-
-            switch (waveform.get()) {
-                case Cosine:
-                case Sine:
-                    do {
-                        block = A*kfr::cexp(j2pi * (phi + ((waveform == Sine) ? -0.25f : 0.0f) +
-                                                    cycles_per_sample*kfr::counter()));
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, complex_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Square:
-                    do {
-                        auto im = cycles_per_sample < 0 ? -J : J;
-                        block = A*(kfr::squarenorm(phi + cycles_per_sample*kfr::counter()) +
-                                   im*kfr::fir(hilb, kfr::squarenorm(phi + (cycles_per_sample*hilb_delay) +
-                                                                     cycles_per_sample*kfr::counter())));
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, complex_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Triangle:
-                    do {
-                        auto im = cycles_per_sample < 0 ? -J : J;
-                        block = A*(kfr::trianglenorm(phi + cycles_per_sample*kfr::counter()) +
-                                   im*kfr::fir(hilb, kfr::trianglenorm(phi + (cycles_per_sample*hilb_delay) +
-                                                                       cycles_per_sample*kfr::counter())));
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, complex_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                case Sawtooth:
-                    do {
-                        auto im = cycles_per_sample < 0 ? -J : J;
-                        block = A*(kfr::sawtoothnorm(phi + cycles_per_sample*kfr::counter()) +
-                                   im*kfr::fir(hilb, kfr::sawtoothnorm(phi + (cycles_per_sample*hilb_delay) +
-                                                                       cycles_per_sample*kfr::counter())));
-                        phi = kfr::fract(phi + phi_incr);
-                        sink.send(pkt, complex_data);
-                    } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
-                    break;
-                default:
-                    break;
+                if (analytic && harmonic_count(cycles_per_sample) != harmonics) {
+                    harmonics = harmonic_count(cycles_per_sample);
+                    table_bits = analytic_table(waveform, harmonics, k, table);
+                }
             }
         }
+
+        do {
+            generate(data);
+            sink.send(pkt, data);
+        } while (no_source || !freq_msg_set.load(std::memory_order_acquire));
     }
 
     return 0;
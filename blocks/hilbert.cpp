@@ -16,84 +16,254 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "hilbert.hpp"
+#include "async.hpp"
+#include "hilbert_engine.hpp"
+#include "kernels.hpp"
 #include "options.hpp"
 #include "signal.hpp"
 #include "stream.hpp"
+#include "thread_pool.hpp"
 
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <vector>
 
 using namespace sdr;
 
+enum Mode {
+    Analytic,
+    Fs4
+};
+
+template<>
+const opt::Option<Mode>::value_map opt::Option<Mode>::values = {
+    { "analytic", Analytic },
+    { "fs4",      Fs4      },
+};
+
+// Filter state of one stream. Real input turns into the analytic signal,
+// complex input is transformed as is; histories never mix the two. The
+// fs/4 mode only takes real input, at half the rate.
+struct Channel {
+    std::unique_ptr<HilbertEngine> hilb;
+    std::unique_ptr<Fs4Engine> fs4;
+
+    bool real_input = false;
+    std::size_t delay = 0;
+};
+
+// Packet read ahead of processing. Packets of other streams are kept too,
+// so that output order matches the input.
+struct Entry {
+    Packet pkt;
+    bool process;
+    bool emit;
+
+    PacketBuffer data;
+    PacketBuffer out;
+};
+
 int main(int argc, char* argv[]) {
-    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+    Option<std::set<std::uintmax_t>> ids("stream", Placeholder("ID,..."));
     Option<std::uintmax_t> taps("taps", Placeholder("TAPS"), 127);
     Option<bool> delay("delay", true);
+    Option<Mode> mode("mode", Analytic);
+    Option<bool> all("all", false);
+    Option<std::uintmax_t> batch("batch", Placeholder("PACKETS"), 0);
 
-    if (!opt::parse({ id, taps }, { delay }, argv, argv + argc))
+    if (!opt::parse({ ids, taps }, { delay, mode, all, batch }, argv, argv + argc))
         return -1;
 
-    if (!valid_stream_id(id.get())) {
-        std::cerr << "error: gen: " << id.get() << " is not a valid stream id" << std::endl;
+    const std::set<std::uintmax_t> streams =
+        ids.is_set() ? ids.get() : std::set<std::uintmax_t>{ 0 };
+
+    for (auto id: streams) {
+        if (!valid_stream_id(id)) {
+            std::cerr << "error: hilbert: " << id << " is not a valid stream id" << std::endl;
+            return -1;
+        }
+    }
+
+    if (taps < 3 || taps > (std::uintmax_t(1) << 20)) {
+        std::cerr << "error: hilbert: taps must be between 3 and 2^20" << std::endl;
         return -1;
     }
 
-    Source source;
-    Sink sink;
+    auto& k = kernels::active();
+    auto& pool = ThreadPool::global();
 
-    kfr::fir_state<RealSample, Sample> hilb(hilbert<RealSample>(taps.get()));
-    std::size_t hilb_delay = delay ? (std::size_t(taps.get()) - 1) / 2 : 0;
+    // A single stream gains nothing from read-ahead, batches only apply
+    // to several streams
+    const bool single = !all && streams.size() == 1;
+    const std::size_t limit = batch.get() ? std::size_t(batch.get()) : 2*pool.concurrency();
 
-    std::vector<RealSample, SampleAllocator<RealSample>> real_data;
-    std::vector<Sample, SampleAllocator<Sample>> input_data;
+    std::map<std::uint16_t, Channel> channels;
 
-    std::vector<Sample, SampleAllocator<Sample>> output_data;
+    // Engines are built on the processing threads; the filter form is timed
+    // once per input type and shared by all streams
+    std::mutex choice_lock;
+    bool chosen[3] = { false, false, false };
+    FirEngine engines[3];
+    std::size_t sizes[3];
 
-    while (source.next()) {
-        auto pkt = source.packet();
+    auto create = [&](Channel& ch, bool real, std::size_t count) {
+        std::lock_guard<std::mutex> guard(choice_lock);
 
-        if (pkt.id != id || (pkt.content != Packet::Signal &&
-                             pkt.content != Packet::ComplexSignal))
-            source.pass(sink);
+        const std::size_t kind = mode == Fs4 ? 2 : real;
+        const FirEngine engine = chosen[kind] ? engines[kind] : FirEngine::Auto;
+        const std::size_t size = chosen[kind] ? sizes[kind] : 0;
+
+        ch.real_input = real;
 
-        if (pkt.content == Packet::Signal) {
-            real_data.resize(pkt.count<RealSample>());
-            real_data.resize(source.recv(real_data));
-            input_data.resize(real_data.size());
-            std::copy(real_data.begin(), real_data.end(), input_data.begin());
+        if (mode == Fs4) {
+            ch.fs4.reset(new Fs4Engine(k, taps.get(), count, engine, size));
+            ch.delay = delay ? ch.fs4->delay() : 0;
+            engines[kind] = ch.fs4->engine();
+            sizes[kind] = ch.fs4->size();
         } else {
-            input_data.resize(pkt.count<Sample>());
-            input_data.resize(source.recv(input_data));
+            ch.hilb.reset(new HilbertEngine(k, taps.get(), !real, count, engine, size));
+            ch.delay = delay ? ch.hilb->delay() : 0;
+            engines[kind] = ch.hilb->engine();
+            sizes[kind] = ch.hilb->size();
         }
 
-        output_data.resize(input_data.size());
+        chosen[kind] = true;
+    };
+
+    // Filters one packet into buf, updating its header; false when there
+    // is nothing to emit yet
+    auto process = [&](Channel& ch, Packet& pkt, float const* input, PacketBuffer& buf) {
+        const bool real = pkt.content == Packet::Signal;
+        const std::size_t count = real ? pkt.count<RealSample>() : pkt.count<Sample>();
 
-        kfr::make_univector(output_data.data(), output_data.size()) =
-            kfr::fir(hilb, kfr::make_univector(input_data.data(), input_data.size()));
+        if (count == 0)
+            return false;
 
-        std::size_t skip = std::min(output_data.size(), hilb_delay);
+        std::size_t outputs;
 
-        if (skip > 0) {
-            hilb_delay -= skip;
+        if (mode == Fs4) {
+            if (!ch.fs4)
+                create(ch, real, count);
 
-            pkt.size -= skip * (pkt.content == Packet::Signal ? sizeof(RealSample)
-                                                              : sizeof(Sample));
-            pkt.duration -= (skip*pkt.duration)/input_data.size();
+            buf.resize(((count + 1)/2)*sizeof(Sample));
+            outputs = ch.fs4->apply(reinterpret_cast<float*>(buf.data()), input, count);
+        } else {
+            if (!ch.hilb || real != ch.real_input)
+                create(ch, real, count);
 
-            if (pkt.size == 0)
-                continue;
+            buf.resize(count*sizeof(Sample));
+            ch.hilb->apply(reinterpret_cast<float*>(buf.data()), input, count);
+            outputs = count;
         }
 
-        if (pkt.content == Packet::Signal) {
-            real_data.resize(output_data.size() - skip);
-            std::transform(output_data.begin() + skip, output_data.end(),
-                           real_data.begin(), [](Sample s) { return s.real(); });
-            sink.send(pkt, real_data);
-        } else {
-            sink.send(pkt, output_data.data() + skip, output_data.size() - skip);
+        const std::size_t skip = std::min(outputs, ch.delay);
+        ch.delay -= skip;
+
+        if (skip == outputs)
+            return false;
+
+        auto out = reinterpret_cast<Sample*>(buf.data());
+        if (skip > 0)
+            std::copy(out + skip, out + outputs, out);
+
+        pkt.content = Packet::ComplexSignal;
+        pkt.size = std::uint32_t((outputs - skip)*sizeof(Sample));
+        pkt.duration -= (skip*pkt.duration)/outputs;
+
+        return true;
+    };
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    std::vector<Entry> entries;
+    std::size_t used = 0, pending = 0;
+
+    PacketBuffer output;
+
+    // Streams run in parallel, packets of each stream in order
+    auto flush = [&]() {
+        std::map<std::uint16_t, std::vector<std::size_t>> groups;
+        for (std::size_t i = 0; i < used; ++i) {
+            if (entries[i].process)
+                groups[entries[i].pkt.id].push_back(i);
+        }
+
+        {
+            TaskGroup group(pool);
+            std::size_t affinity = 0;
+
+            for (auto& g: groups) {
+                auto& ch = channels[g.first];
+                auto& list = g.second;
+
+                auto task = [&]() {
+                    for (auto i: list) {
+                        auto& e = entries[i];
+                        e.emit = process(ch, e.pkt, reinterpret_cast<float const*>(e.data.data()),
+                                         e.out);
+                    }
+                };
+
+                if (groups.size() == 1)
+                    task();
+                else
+                    group.run(task, affinity++);
+            }
+
+            group.wait();
+        }
+
+        for (std::size_t i = 0; i < used; ++i) {
+            auto& e = entries[i];
+
+            if (!e.process)
+                sink.send(e.pkt, e.data);
+            else if (e.emit)
+                sink.send(e.pkt, e.out);
+        }
+
+        used = pending = 0;
+    };
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        const bool accepted =
+            (all || streams.count(pkt.id)) &&
+            (pkt.content == Packet::Signal || pkt.content == Packet::ComplexSignal) &&
+            (mode != Fs4 || pkt.content == Packet::Signal);
+
+        // Nothing to keep order with
+        if (!accepted && used == 0) {
+            source.pass(sink);
+            continue;
         }
+
+        // A single stream is filtered straight from the source buffer
+        if (single) {
+            if (process(channels[pkt.id], pkt, source.data<float>(), output))
+                sink.send(pkt, output);
+            continue;
+        }
+
+        if (used == entries.size())
+            entries.emplace_back();
+
+        auto& e = entries[used++];
+        e.pkt = pkt;
+        e.process = accepted;
+        e.data.assign(source.data(), source.data() + pkt.size);
+
+        if (accepted && ++pending >= limit)
+            flush();
     }
 
+    if (used)
+        flush();
+
     return 0;
 }
@@ -0,0 +1,295 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace sdr;
+
+enum Mode {
+    Real,
+    Complex
+};
+
+template<>
+const opt::Option<Mode>::value_map opt::Option<Mode>::values = {
+    { "real",    Real    },
+    { "complex", Complex },
+};
+
+// Frames are windowed with a periodic 4-term Blackman-Harris, whose
+// transform is below -92 dB past 4 bins from the peak, so each tone only
+// touches a few bins. Frames overlap by half and the output is divided by
+// the sum of the two windows, which stays above 0.43.
+static constexpr double window_terms[4] = { 0.35875, 0.48829, 0.14128, 0.01168 };
+static constexpr int kernel_width = 6;
+static constexpr int kernel_size = 2*kernel_width + 1;
+
+struct Tone {
+    double cycles;
+    double amp;
+    double phase;
+};
+
+// A tone as it enters each frame spectrum: kernel bins around its
+// center, rotated by the phase at the start of the frame
+struct ToneKernel {
+    std::ptrdiff_t center;
+    std::complex<float> bins[kernel_size];
+    std::uint64_t phase;
+    std::uint64_t step;
+};
+
+// Lines of "FREQ [AMPLITUDE [PHASE]]", # starts a comment
+static bool read_tones(std::string const& path, std::vector<std::array<double, 3>>& tones) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    for (std::string line; std::getline(file, line); ) {
+        std::istringstream stream(line.substr(0, line.find('#')));
+
+        std::array<double, 3> tone{ { 0.0, 1.0, 0.0 } };
+        std::size_t count = 0;
+
+        while (count < 3 && stream >> tone[count])
+            ++count;
+
+        // Anything else on the line is an error
+        std::string rest;
+        if (count < 3 ? !stream.eof() : bool(stream >> rest))
+            return false;
+
+        if (count)
+            tones.push_back(tone);
+    }
+
+    return true;
+}
+
+static double window(std::size_t i, std::size_t n) {
+    const double x = 2*M_PI*i/n;
+    return window_terms[0] - window_terms[1]*std::cos(x) +
+           window_terms[2]*std::cos(2*x) - window_terms[3]*std::cos(3*x);
+}
+
+// Transform of amp*w[n]*exp(j*2*pi*cycles*n) on the bins nearest to the
+// tone, scaled by the inverse transform gain. Each window term is a sum
+// of shifted Dirichlet kernels
+// sum_n exp(j*2*pi*x*n/N) = exp(j*pi*x*(N-1)/N)*sin(pi*x)/sin(pi*x/N).
+static ToneKernel tone_kernel(Tone const& tone, std::size_t n, std::size_t hop) {
+    const double bin = tone.cycles*n;
+    const double center = std::round(bin);
+    const double offset = bin - center;
+
+    auto dirichlet = [&](double x) {
+        const double den = std::sin(M_PI*x/n);
+        const double mag = std::fabs(x) < 1e-9 ? double(n) : std::sin(M_PI*x)/den;
+        return std::polar(mag, M_PI*x*(n - 1)/n);
+    };
+
+    const double scale = tone.amp/n;
+
+    ToneKernel kernel;
+    kernel.center = std::ptrdiff_t(center);
+
+    for (int d = -kernel_width; d <= kernel_width; ++d) {
+        std::complex<double> sum = window_terms[0]*dirichlet(offset - d);
+
+        for (int i = 1; i < 4; ++i) {
+            const double c = (i & 1 ? -0.5 : 0.5)*window_terms[i];
+            sum += c*(dirichlet(offset - d + i) + dirichlet(offset - d - i));
+        }
+
+        kernel.bins[d + kernel_width] = std::complex<float>(scale*sum);
+    }
+
+    kernel.phase = to_phase(tone.phase);
+    kernel.step = to_phase(tone.cycles*hop);
+
+    return kernel;
+}
+
+int main(int argc, char* argv[]) {
+    Option<std::vector<double>> freq("freq", Placeholder("FREQ,..."));
+    FreqUnitNoStreamOption unit("unit", FreqUnit::Hertz);
+    Option<std::uintmax_t> sample_rate("sample_rate", Placeholder("HERTZ"), 0);
+    Option<std::vector<double>> amplitude("amp", Placeholder("AMPLITUDE,..."), { 1.0 });
+    Option<std::vector<double>> phase("phi", Placeholder("PHASE,..."), { 0.0 });
+    Option<std::string> file("file", "");
+    Option<Mode> mode("mode", Complex);
+    Option<std::uintmax_t> size("size", Placeholder("POINTS"), 16384);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ freq },
+                    { unit, sample_rate, amplitude, phase, file, mode, size, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: multitone: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    if (sample_rate == 0) {
+        std::cerr << "error: multitone: option 'sample_rate' is required" << std::endl;
+        return -1;
+    }
+
+    const std::size_t n = size;
+
+    if (n < 64 || (n & (n - 1)) || n > (std::size_t(1) << 24)) {
+        std::cerr << "error: multitone: size must be a power of two between 64 and 2^24" << std::endl;
+        return -1;
+    }
+
+    // Frequency, amplitude and phase in degrees of every tone; a single
+    // amplitude or phase applies to all tones
+    std::vector<std::array<double, 3>> list;
+
+    if (file.is_set() && !read_tones(file.get(), list)) {
+        std::cerr << "error: multitone: cannot read tones from " << file.get() << std::endl;
+        return -1;
+    }
+
+    auto const& freqs = freq.get();
+    auto const& amps = amplitude.get();
+    auto const& phases = phase.get();
+
+    if ((amps.size() != 1 && amps.size() != freqs.size()) ||
+        (phases.size() != 1 && phases.size() != freqs.size())) {
+        std::cerr << "error: multitone: amp and phi need one value or one per frequency" << std::endl;
+        return -1;
+    }
+
+    for (std::size_t i = 0; i < freqs.size(); ++i)
+        list.push_back({ { freqs[i], amps[amps.size() == 1 ? 0 : i],
+                           phases[phases.size() == 1 ? 0 : i] } });
+
+    if (list.empty()) {
+        std::cerr << "error: multitone: no tones given, use freq or file" << std::endl;
+        return -1;
+    }
+
+    const std::size_t hop = n/2;
+    const bool real = mode == Real;
+
+    // Real output takes the real part of the complex sum, so each tone
+    // contributes half its amplitude to both sides of the spectrum
+    std::vector<ToneKernel> tones;
+    tones.reserve(list.size());
+
+    for (auto const& t : list) {
+        Tone tone{ convert_freq(unit.get(), t[0], sample_rate), t[1], t[2]/360.0 };
+        if (real)
+            tone.amp *= 0.5;
+
+        // Start half a frame early, so that the first hop out is complete
+        tone.phase -= tone.cycles*double(hop);
+
+        tones.push_back(tone_kernel(tone, n, hop));
+    }
+
+    auto& k = kernels::active();
+    auto dft = real ? k.real_dft(n) : k.dft(n);
+
+    std::vector<Sample, SampleAllocator<Sample>> spectrum(n);
+    std::vector<Sample, SampleAllocator<Sample>> folded(real ? n/2 + 1 : 0);
+
+    const std::size_t width = real ? 1 : 2;
+    std::vector<RealSample, SampleAllocator<RealSample>> frame(n*width);
+    std::vector<RealSample, SampleAllocator<RealSample>> tail(hop*width);
+    std::vector<RealSample, SampleAllocator<RealSample>> data(hop*width);
+
+    std::vector<RealSample, SampleAllocator<RealSample>> gain(hop);
+    for (std::size_t i = 0; i < hop; ++i)
+        gain[i] = RealSample(1.0/(window(i, n) + window(i + hop, n)));
+
+    Sink sink;
+
+    const Packet pkt = {
+        std::uint16_t(id), real ? Packet::Signal : Packet::ComplexSignal,
+        std::uint32_t(hop*width*sizeof(RealSample)), 0
+    };
+
+    const double hop_ns = hop*1e9/sample_rate;
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    const std::ptrdiff_t mask = std::ptrdiff_t(n) - 1;
+
+    auto bins = reinterpret_cast<std::complex<float>*>(spectrum.data());
+    auto half = reinterpret_cast<std::complex<float>*>(folded.data());
+
+    for (std::size_t frames = 0;; ++frames) {
+        std::fill(bins, bins + n, std::complex<float>());
+
+        for (auto& tone : tones) {
+            const double angle = std::ldexp(double(tone.phase), -64)*2*M_PI;
+            const std::complex<float> rot(float(std::cos(angle)), float(std::sin(angle)));
+            tone.phase += tone.step;
+
+            for (int d = 0; d < kernel_size; ++d)
+                bins[(tone.center + d - kernel_width) & mask] += rot*tone.bins[d];
+        }
+
+        if (real) {
+            // Hermitian part, the spectrum of the real part of the sum
+            for (std::size_t b = 0; b <= n/2; ++b)
+                half[b] = bins[b] + std::conj(bins[(n - b) & (n - 1)]);
+
+            dft->inverse(frame.data(), reinterpret_cast<float const*>(folded.data()));
+        } else {
+            dft->inverse(frame.data(), reinterpret_cast<float const*>(spectrum.data()));
+        }
+
+        // The first half of a frame completes the second half of the last
+        k.accumulate(tail.data(), frame.data(), hop*width);
+
+        if (frames > 0) {
+            if (real)
+                k.multiply(data.data(), tail.data(), gain.data(), hop);
+            else
+                k.multiply_complex(data.data(), tail.data(), gain.data(), hop);
+
+            elapsed += hop_ns;
+
+            Packet out = pkt;
+            out.duration = std::uint64_t(elapsed) - emitted;
+            emitted += out.duration;
+
+            sink.send(out, data);
+        }
+
+        std::copy(frame.begin() + hop*width, frame.end(), tail.begin());
+    }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/fir_design.hpp"
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+enum Quality {
+    Draft,
+    Low,
+    Normal,
+    High
+};
+
+template<>
+const opt::Option<Quality>::value_map opt::Option<Quality>::values = {
+    { "draft",  Draft  },
+    { "low",    Low    },
+    { "normal", Normal },
+    { "high",   High   },
+};
+
+struct Design {
+    std::size_t taps;
+    double beta;
+    double passband;
+};
+
+// Taps per input sample of the narrower band, Kaiser beta and cutoff as a
+// fraction of the narrower Nyquist band
+static const Design designs[] = {
+    {  8,  5.0, 0.80 },
+    { 16,  7.0, 0.85 },
+    { 32,  9.0, 0.90 },
+    { 64, 12.0, 0.94 },
+};
+
+int main(int argc, char* argv[]) {
+    Option<std::uintmax_t> interpolation("interpolation", Placeholder("FACTOR"), 1);
+    Option<std::uintmax_t> decimation("decimation", Placeholder("FACTOR"), 1);
+    Option<Quality> quality("quality", Normal);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ interpolation, decimation }, { quality, id }, argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: resample: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    if (interpolation < 1 || decimation < 1 ||
+        interpolation > 4096 || decimation > (std::uintmax_t(1) << 20)) {
+        std::cerr << "error: resample: factors must be between 1 and 4096 (interpolation)"
+                     " or 2^20 (decimation)" << std::endl;
+        return -1;
+    }
+
+    const std::size_t common = kfr::gcd(std::size_t(interpolation), std::size_t(decimation));
+    const std::size_t up = interpolation/common, down = decimation/common;
+
+    const Design& design = designs[quality.get()];
+
+    // Decimation needs proportionally longer filters
+    const std::size_t depth = design.taps*((down + up - 1)/up);
+
+    // Polyphase branch p holds taps p, p + up, p + 2*up..., time reversed
+    // so that they line up with the input history
+    std::vector<RealSample, SampleAllocator<RealSample>> branches(up*depth);
+    {
+        const std::size_t length = up*depth;
+        const double cutoff = 0.5*design.passband/std::max(up, down);
+
+        kfr::univector<double> h(length);
+        auto window = kfr::window_kaiser<double>(length, design.beta);
+        kfr::fir_lowpass(h, cutoff, kfr::to_pointer(window));
+
+        for (std::size_t p = 0; p < up; ++p) {
+            for (std::size_t j = 0; j < depth; ++j)
+                branches[p*depth + j] = RealSample(up*h[p + (depth - 1 - j)*up]);
+        }
+    }
+
+    auto& k = kernels::active();
+
+    // Input history, as floats
+    std::vector<RealSample, SampleAllocator<RealSample>> line;
+
+    bool real_input = false;
+
+    // Input sample the next output window ends on, and its branch
+    std::size_t pos = 0;
+    std::size_t phase = 0;
+
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (pkt.id != id || (pkt.content != Packet::Signal &&
+                             pkt.content != Packet::ComplexSignal)) {
+            source.pass(sink);
+            continue;
+        }
+
+        const bool real = pkt.content == Packet::Signal;
+        const std::size_t width = real ? 1 : 2;
+        const std::size_t count = real ? pkt.count<RealSample>() : pkt.count<Sample>();
+
+        if (count == 0)
+            continue;
+
+        // Histories never mix real and complex samples
+        if (real != real_input || line.empty()) {
+            real_input = real;
+            line.assign((depth - 1)*width, 0.0f);
+            pos = depth - 1;
+            phase = 0;
+        }
+
+        auto input = source.data<RealSample>();
+        line.insert(line.end(), input, input + count*width);
+
+        const std::size_t size = line.size()/width;
+        elapsed += double(pkt.duration);
+
+        if (pos < size) {
+            // Upper bound, the packet only carries what is produced
+            const std::size_t capacity = ((size - pos)*up + phase)/down + 1;
+            auto out = sink.buffer<RealSample>(std::uint32_t(capacity*width));
+            std::size_t outputs = 0;
+
+            for (; pos < size; ++outputs) {
+                auto window = line.data() + (pos + 1 - depth)*width;
+                auto taps = branches.data() + phase*depth;
+
+                if (real)
+                    out[outputs] = k.dot(window, taps, depth);
+                else
+                    k.dot_complex(out + 2*outputs, window, taps, depth);
+
+                phase += down;
+                pos += phase/up;
+                phase %= up;
+            }
+
+            const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+            emitted += duration;
+
+            sink.commit({ pkt.id, pkt.content,
+                          std::uint32_t(outputs*width*sizeof(RealSample)), duration });
+        }
+
+        // Keep the history of the next window
+        const std::size_t drop = std::min(pos + 1 - depth, size - (depth - 1));
+        line.erase(line.begin(), line.begin() + drop*width);
+        pos -= drop;
+    }
+
+    return 0;
+}
@@ -0,0 +1,334 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+enum Output {
+    Complex,
+    Power,
+    Magnitude
+};
+
+template<>
+const opt::Option<Output>::value_map opt::Option<Output>::values = {
+    { "complex",   Complex   },
+    { "power",     Power     },
+    { "magnitude", Magnitude },
+};
+
+enum Average {
+    NoAverage,
+    Welch,
+    Exponential,
+    MaxHold,
+    MinHold
+};
+
+template<>
+const opt::Option<Average>::value_map opt::Option<Average>::values = {
+    { "none",        NoAverage   },
+    { "welch",       Welch       },
+    { "exponential", Exponential },
+    { "max",         MaxHold     },
+    { "min",         MinHold     },
+};
+
+enum Units {
+    Linear,
+    Decibels
+};
+
+template<>
+const opt::Option<Units>::value_map opt::Option<Units>::values = {
+    { "linear", Linear   },
+    { "db",     Decibels },
+};
+
+template<>
+const opt::Option<kfr::window_type>::value_map opt::Option<kfr::window_type>::values = {
+    { "rectangular",     kfr::window_type::rectangular     },
+    { "triangular",      kfr::window_type::triangular      },
+    { "bartlett",        kfr::window_type::bartlett        },
+    { "cosine",          kfr::window_type::cosine          },
+    { "hann",            kfr::window_type::hann            },
+    { "bartlett_hann",   kfr::window_type::bartlett_hann   },
+    { "hamming",         kfr::window_type::hamming         },
+    { "bohman",          kfr::window_type::bohman          },
+    { "blackman",        kfr::window_type::blackman        },
+    { "blackman_harris", kfr::window_type::blackman_harris },
+    { "kaiser",          kfr::window_type::kaiser          },
+    { "flattop",         kfr::window_type::flattop         },
+    { "gaussian",        kfr::window_type::gaussian        },
+    { "lanczos",         kfr::window_type::lanczos         },
+};
+
+static float default_window_param(kfr::window_type type) {
+    switch (type) {
+        case kfr::window_type::hamming:
+            return 0.54f;
+        case kfr::window_type::blackman:
+            return 0.16f;
+        case kfr::window_type::kaiser:
+            return 0.5f;
+        case kfr::window_type::gaussian:
+            return 2.5f;
+        default:
+            return 0.0f;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+    Option<std::uintmax_t> size("size", Placeholder("POINTS"), 1024);
+    Option<kfr::window_type> window("window", kfr::window_type::hann);
+    Option<float> window_param("window_param", Placeholder("VALUE"), 0.0f);
+    Option<float> overlap("overlap", Placeholder("FRACTION"), 0.5f);
+    Option<Output> output("output", Power);
+    Option<Average> average("average", NoAverage);
+    Option<std::uintmax_t> frames("frames", Placeholder("COUNT"), 16);
+    Option<float> alpha("alpha", Placeholder("VALUE"), 0.0f);
+    Option<Units> units("units", Linear);
+
+    if (!opt::parse({ id, size },
+                    { window, window_param, overlap, output, average, frames, alpha, units },
+                    argv, argv + argc))
+        return -1;
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: spectrum: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    const std::size_t n = size;
+
+    if (n < 4 || (n & (n - 1)) || n > (std::size_t(1) << 24)) {
+        std::cerr << "error: spectrum: size must be a power of two between 4 and 2^24" << std::endl;
+        return -1;
+    }
+
+    if (!(overlap >= 0.0f && overlap < 1.0f)) {
+        std::cerr << "error: spectrum: overlap must be in the range [0, 1)" << std::endl;
+        return -1;
+    }
+
+    if (output == Complex && (average != NoAverage || units != Linear)) {
+        std::cerr << "error: spectrum: averaging and db units need power or magnitude output" << std::endl;
+        return -1;
+    }
+
+    if (frames < 1) {
+        std::cerr << "error: spectrum: frames must be at least 1" << std::endl;
+        return -1;
+    }
+
+    // Same center of mass as a plain average over the period by default
+    const float smoothing = alpha.is_set() ? alpha.get() : 2.0f/(frames + 1);
+
+    if (!(smoothing > 0.0f && smoothing <= 1.0f)) {
+        std::cerr << "error: spectrum: alpha must be in the range (0, 1]" << std::endl;
+        return -1;
+    }
+
+    // Without averaging every frame is a period of its own
+    const std::size_t period = average == NoAverage ? 1 : std::size_t(frames);
+
+    const std::size_t hop = std::max(std::size_t(1), n - std::size_t(std::lround(overlap * n)));
+
+    auto& k = kernels::active();
+
+    // Normalized to unit coherent gain, so a full-scale tone reads 1
+    std::vector<RealSample, SampleAllocator<RealSample>> win(n);
+    {
+        using kfr::window_type;
+
+        const RealSample param =
+            window_param.is_set() ? window_param.get() : default_window_param(window.get());
+
+        kfr::univector<RealSample> w(n);
+        kfr::cswitch(kfr::cvals_t<window_type,
+                                  window_type::rectangular, window_type::triangular,
+                                  window_type::bartlett, window_type::cosine,
+                                  window_type::hann, window_type::bartlett_hann,
+                                  window_type::hamming, window_type::bohman,
+                                  window_type::blackman, window_type::blackman_harris,
+                                  window_type::kaiser, window_type::flattop,
+                                  window_type::gaussian, window_type::lanczos>(),
+                     window.get(), [&](auto type) {
+            w = kfr::window<RealSample>(n, type, param, kfr::window_symmetry::periodic);
+        });
+
+        const RealSample gain = kfr::sum(w);
+        std::transform(w.begin(), w.end(), win.begin(), [gain](RealSample x) { return x / gain; });
+    }
+
+    std::unique_ptr<kernels::Dft> real_dft, complex_dft;
+
+    // Room for n complex samples, reused for real input
+    std::vector<Sample, SampleAllocator<Sample>> frame(n);
+    std::vector<Sample, SampleAllocator<Sample>> windowed(n);
+    std::vector<Sample, SampleAllocator<Sample>> bins(output == Complex ? 0 : n);
+
+    // Power is accumulated in place and only converted when emitted
+    std::vector<RealSample, SampleAllocator<RealSample>> acc(output == Complex ? 0 : n);
+    std::vector<RealSample, SampleAllocator<RealSample>> power(
+        output == Complex || average == NoAverage ? 0 : n);
+
+    std::size_t fill = 0;
+    bool real_input = false;
+
+    std::size_t accumulated = 0;
+    bool primed = false;
+
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (pkt.id != id || (pkt.content != Packet::Signal &&
+                             pkt.content != Packet::ComplexSignal)) {
+            source.pass(sink);
+            continue;
+        }
+
+        const bool real = pkt.content == Packet::Signal;
+        const std::size_t width = real ? 1 : 2;
+        const std::size_t count = real ? pkt.count<RealSample>() : pkt.count<Sample>();
+
+        if (count == 0)
+            continue;
+
+        // Frames never mix real and complex samples
+        if (real != real_input) {
+            real_input = real;
+            fill = 0;
+            accumulated = 0;
+            primed = false;
+        }
+
+        auto& dft = real ? real_dft : complex_dft;
+        if (!dft)
+            dft = real ? k.real_dft(n) : k.dft(n);
+
+        const std::size_t nbins = real ? n/2 + 1 : n;
+        const double sample_ns = double(pkt.duration) / count;
+
+        auto input = source.data<float>();
+        auto frame_data = reinterpret_cast<float*>(frame.data());
+        auto windowed_data = reinterpret_cast<float*>(windowed.data());
+
+        for (std::size_t pos = 0; pos < count; ) {
+            const std::size_t take = std::min(count - pos, n - fill);
+
+            std::copy_n(input + pos*width, take*width, frame_data + fill*width);
+            fill += take;
+            pos += take;
+
+            if (fill < n)
+                continue;
+
+            if (real)
+                k.multiply(windowed_data, frame_data, win.data(), n);
+            else
+                k.multiply_complex(windowed_data, frame_data, win.data(), n);
+
+            elapsed += hop*sample_ns;
+
+            if (output == Complex) {
+                const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+                emitted += duration;
+
+                dft->forward(reinterpret_cast<float*>(sink.buffer<Sample>(nbins)), windowed_data);
+                sink.commit({ pkt.id, Packet::ComplexSpectrum,
+                              std::uint32_t(nbins*sizeof(Sample)), duration });
+            } else {
+                auto bins_data = reinterpret_cast<float*>(bins.data());
+                dft->forward(bins_data, windowed_data);
+
+                // The first frame of a period (or of the stream, for the
+                // moving average) initializes the accumulator directly
+                if (accumulated == 0 && (average != Exponential || !primed)) {
+                    k.power(acc.data(), bins_data, nbins);
+                    primed = true;
+                } else {
+                    k.power(power.data(), bins_data, nbins);
+
+                    switch (average.get()) {
+                        case Welch:
+                            k.accumulate(acc.data(), power.data(), nbins);
+                            break;
+                        case Exponential:
+                            k.smooth(acc.data(), power.data(), nbins, smoothing);
+                            break;
+                        case MaxHold:
+                            k.maximum(acc.data(), power.data(), nbins);
+                            break;
+                        case MinHold:
+                            k.minimum(acc.data(), power.data(), nbins);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+
+                if (++accumulated == period) {
+                    accumulated = 0;
+
+                    const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+                    emitted += duration;
+
+                    const float factor = average == Welch ? 1.0f/period : 1.0f;
+                    auto out = sink.buffer<RealSample>(nbins);
+
+                    // Power and magnitude coincide in dB
+                    if (units == Decibels)
+                        k.decibels(out, acc.data(), nbins, factor);
+                    else if (output == Power)
+                        k.scale(out, acc.data(), nbins, factor);
+                    else
+                        k.root(out, acc.data(), nbins, factor);
+
+                    sink.commit({ pkt.id, Packet::Spectrum,
+                                  std::uint32_t(nbins*sizeof(RealSample)), duration });
+                }
+            }
+
+            // Keep the overlapping tail for the next frame
+            std::copy(frame_data + hop*width, frame_data + n*width, frame_data);
+            fill = n - hop;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+enum Sweep {
+    Linear,
+    Logarithmic,
+    Sawtooth
+};
+
+template<>
+const opt::Option<Sweep>::value_map opt::Option<Sweep>::values = {
+    { "linear",   Linear      },
+    { "log",      Logarithmic },
+    { "sawtooth", Sawtooth    },
+};
+
+enum Mode {
+    Real,
+    Complex
+};
+
+template<>
+const opt::Option<Mode>::value_map opt::Option<Mode>::values = {
+    { "real",    Real    },
+    { "complex", Complex },
+};
+
+// Logarithmic sweeps are linear within short segments, on chords of the
+// exponential scaled down so that each segment lands on its exact phase:
+// phase never drifts and frequency never steps. Segments are short enough
+// to keep phase within a segment this many cycles from the exponential.
+static constexpr double log_tolerance = 1.0/(1 << 24);
+static constexpr std::uint64_t max_log_segment = 4096;
+
+int main(int argc, char* argv[]) {
+    Option<double> start("start", Placeholder("FREQ"), Required);
+    Option<double> stop("stop", Placeholder("FREQ"), Required);
+    FreqUnitNoStreamOption unit("unit", FreqUnit::Hertz);
+    Option<Sweep> sweep("sweep", Linear);
+    Option<double> duration("time", Placeholder("SECONDS"), 1.0);
+    Option<std::uintmax_t> sample_rate("sample_rate", Placeholder("HERTZ"), Required);
+    Option<float> amplitude("amp", Placeholder("AMPLITUDE"), 1.0f);
+    Option<float> phase("phi", Placeholder("PHASE"), 0.0f);
+    Option<Mode> mode("mode", Complex);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ start, stop, unit, sweep },
+                    { duration, sample_rate, amplitude, phase, mode, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!start.is_set() || !stop.is_set() || !sample_rate.is_set()) {
+        std::cerr << "error: sweep: options 'start', 'stop' and 'sample_rate' are required" << std::endl;
+        opt::usage(argv[0],
+                   { start, stop, unit, sweep },
+                   { duration, sample_rate, amplitude, phase, mode, id });
+        return -1;
+    }
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: sweep: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    const std::uint64_t length = std::uint64_t(std::llround(duration*sample_rate));
+
+    if (!(duration > 0.0) || length == 0) {
+        std::cerr << "error: sweep: time must be at least one sample" << std::endl;
+        return -1;
+    }
+
+    const double f0 = convert_freq(unit.get(), start.get(), sample_rate);
+    const double f1 = convert_freq(unit.get(), stop.get(), sample_rate);
+
+    if (sweep == Logarithmic && !(f0*f1 > 0.0)) {
+        std::cerr << "error: sweep: log sweeps need nonzero frequencies of the same sign" << std::endl;
+        return -1;
+    }
+
+    const std::size_t width = (mode == Real) ? 1 : 2;
+    const std::size_t block_size = optimal_block_size(width*sizeof(RealSample), sample_rate);
+
+    std::vector<RealSample, SampleAllocator<RealSample>> data(block_size*width);
+
+    auto& k = kernels::active();
+    auto generate = (mode == Real) ? k.chirp : k.complex_chirp;
+
+    // Second-order accumulator: linear sweeps have a constant rate, exact
+    // over the whole run, and sawtooth sweeps restart the step each period
+    std::uint64_t acc = to_phase(phase / 360.0);
+    const std::uint64_t start_step = to_phase(f0);
+    std::uint64_t step = start_step;
+    std::uint64_t rate = to_phase((f1 - f0)/double(length));
+
+    // Starts a segment of a logarithmic sweep, matching the phase advance
+    // of the chord to the sum of the geometric series over the segment
+    const double growth = sweep == Logarithmic ? std::log(f1/f0)/double(length) : 0.0;
+    auto log_segment_start = [&](std::uint64_t pos, std::uint64_t count) {
+        const double f = f0*std::exp(growth*double(pos));
+        const double rise = std::expm1(growth*double(count));
+        const double scale = rise/std::expm1(growth)/(double(count) + rise*double(count - 1)/2);
+
+        step = to_phase(f*scale);
+        rate = to_phase(f*scale*rise/double(count));
+    };
+
+    std::uint64_t log_segment = max_log_segment;
+    if (growth != 0.0) {
+        const double peak = std::max(std::fabs(f0), std::fabs(f1));
+        const double segment = std::cbrt(24*log_tolerance/(peak*growth*growth));
+        log_segment = std::uint64_t(std::max(2.0, std::min(double(max_log_segment), segment)));
+    }
+
+    Sink sink;
+
+    const double sample_ns = 1e9/sample_rate;
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    // Position in the current sweep
+    std::uint64_t pos = 0;
+
+    for (;;) {
+        std::size_t count = block_size;
+        if (sweep != Sawtooth)
+            count = std::size_t(std::min<std::uint64_t>(count, length - pos));
+
+        if (count == 0)
+            break;
+
+        for (std::size_t done = 0; done < count; ) {
+            std::size_t n = std::size_t(std::min<std::uint64_t>(count - done, length - pos));
+
+            if (sweep == Logarithmic) {
+                if (pos % log_segment == 0)
+                    log_segment_start(pos, std::min(log_segment, length - pos));
+
+                n = std::size_t(std::min<std::uint64_t>(n, log_segment - pos % log_segment));
+            }
+
+            generate(data.data() + done*width, n, amplitude, acc, step, rate);
+
+            acc += n*step + (std::uint64_t(n)*(n - 1)/2)*rate;
+            step += n*rate;
+            pos += n;
+            done += n;
+
+            if (sweep == Sawtooth && pos == length) {
+                pos = 0;
+                step = start_step;
+            }
+        }
+
+        elapsed += count*sample_ns;
+
+        const Packet pkt = {
+            std::uint16_t(id), (mode == Real) ? Packet::Signal : Packet::ComplexSignal,
+            std::uint32_t(count*width*sizeof(RealSample)), std::uint64_t(elapsed) - emitted
+        };
+        emitted += pkt.duration;
+
+        sink.send(pkt, data.data());
+    }
+
+    return 0;
+}
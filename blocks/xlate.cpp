@@ -0,0 +1,250 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include "kfr/dsp/fir_design.hpp"
+#include "kfr/dsp/window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+// Mixing by exp(-j*2*pi*f*n) before a lowpass h equals filtering with the
+// bandpass h[k]*exp(j*2*pi*f*k) and mixing the filtered samples afterwards,
+// so the oscillator only runs at the output rate and only the outputs that
+// survive decimation are computed.
+//
+// Taps are kept time reversed and split into real dot products: for real
+// input the real and imaginary parts of the bandpass, for interleaved
+// complex input the rows of the complex product.
+class Taps {
+public:
+    explicit Taps(std::vector<double> const& lowpass)
+        : proto(lowpass)
+        {}
+
+    void tune(double f) {
+        const std::size_t n = proto.size();
+
+        real_re.resize(n);
+        real_im.resize(n);
+        complex_re.resize(2*n);
+        complex_im.resize(2*n);
+
+        for (std::size_t j = 0; j < n; ++j) {
+            const std::size_t k = n - 1 - j;
+            const double angle = 2*M_PI*kfr::fract(f*k);
+            const RealSample re = RealSample(proto[k]*std::cos(angle));
+            const RealSample im = RealSample(proto[k]*std::sin(angle));
+
+            real_re[j] = re;
+            real_im[j] = im;
+
+            complex_re[2*j] = re;
+            complex_re[2*j + 1] = -im;
+            complex_im[2*j] = im;
+            complex_im[2*j + 1] = re;
+        }
+    }
+
+    std::vector<double> proto;
+
+    std::vector<RealSample, SampleAllocator<RealSample>> real_re, real_im;
+    std::vector<RealSample, SampleAllocator<RealSample>> complex_re, complex_im;
+};
+
+int main(int argc, char* argv[]) {
+    Option<float> freq("freq", Placeholder("FREQ"), Required);
+    FreqUnitOption unit("unit", FreqUnit::Hertz);
+    Option<std::uintmax_t> decimation("decimation", Placeholder("FACTOR"), Required);
+    Option<std::uintmax_t> sample_rate("sample_rate", Placeholder("HERTZ"), 0);
+    Option<float> bandwidth("bandwidth", Placeholder("HERTZ"), 0.0f);
+    Option<std::uintmax_t> taps("taps", Placeholder("TAPS"), 0);
+    Option<float> beta("beta", Placeholder("VALUE"), 6.0f);
+    Option<std::uintmax_t> id("stream", Placeholder("ID"), 0);
+
+    if (!opt::parse({ freq, unit, decimation },
+                    { sample_rate, bandwidth, taps, beta, id },
+                    argv, argv + argc))
+        return -1;
+
+    if (!freq.is_set() || !decimation.is_set()) {
+        std::cerr << "error: xlate: options 'freq' and 'decimation' are required" << std::endl;
+        opt::usage(argv[0],
+                   { freq, unit, decimation },
+                   { sample_rate, bandwidth, taps, beta, id });
+        return -1;
+    }
+
+    if (unit == FreqUnit::Stream && !valid_stream_id(freq.get())) {
+        std::cerr << "error: xlate: " << freq.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    if (!valid_stream_id(id.get())) {
+        std::cerr << "error: xlate: " << id.get() << " is not a valid stream id" << std::endl;
+        return -1;
+    }
+
+    // Frequency messages may come in any unit but the stream one
+    if (sample_rate == 0 && unit != FreqUnit::Samples) {
+        std::cerr << "error: xlate: option 'sample_rate' is required" << std::endl;
+        return -1;
+    }
+
+    const std::size_t decim = decimation;
+
+    if (decim < 1 || decim > (std::size_t(1) << 16)) {
+        std::cerr << "error: xlate: decimation must be between 1 and 65536" << std::endl;
+        return -1;
+    }
+
+    // Defaults to 80% of the output band and 16 taps per output phase
+    const double cutoff = bandwidth.is_set()
+        ? 0.5*bandwidth.get()/double(sample_rate.get() ? sample_rate.get() : 1)
+        : 0.4/decim;
+
+    if (!(cutoff > 0.0 && cutoff < 0.5)) {
+        std::cerr << "error: xlate: bandwidth must be positive and below the sample rate"
+                  << std::endl;
+        return -1;
+    }
+
+    const std::size_t length = taps.is_set() ? std::size_t(taps.get()) : 16*decim + 1;
+
+    if (length < 1 || length > (std::size_t(1) << 20)) {
+        std::cerr << "error: xlate: taps must be between 1 and 2^20" << std::endl;
+        return -1;
+    }
+
+    Taps bank([&]() {
+        kfr::univector<double> h(length);
+        auto window = kfr::window_kaiser<double>(length, beta.get());
+        kfr::fir_lowpass(h, cutoff, kfr::to_pointer(window));
+        return std::vector<double>(h.begin(), h.end());
+    }());
+
+    const bool no_source = unit != FreqUnit::Stream;
+    const std::uint16_t control = no_source ? 0 : convert_stream_id(freq.get());
+
+    double f = no_source ? convert_freq<double>(unit, freq.get(), sample_rate) : 0.0;
+    bank.tune(f);
+
+    auto& k = kernels::active();
+
+    // Input history and the samples of the current packet, as floats
+    std::vector<RealSample, SampleAllocator<RealSample>> line;
+
+    bool initialized = false;
+    bool real_input = false;
+    std::size_t phase = 0;
+    double nco = 0.0;
+
+    double elapsed = 0.0;
+    std::uint64_t emitted = 0;
+
+    AsyncSource source;
+    AsyncSink sink;
+
+    while (source.next()) {
+        auto pkt = source.packet();
+
+        if (!no_source && pkt.id == control) {
+            auto msg_unit = content_to_unit<FreqUnit>(pkt.content);
+            if (msg_unit != FreqUnit::Stream && pkt.count<float>()) {
+                const double msg = convert_freq<double>(msg_unit, source.data<float>()[0],
+                                                        sample_rate);
+                if (msg != f) {
+                    f = msg;
+                    bank.tune(f);
+                }
+            }
+        }
+
+        if (pkt.id != id || (pkt.content != Packet::Signal &&
+                             pkt.content != Packet::ComplexSignal)) {
+            source.pass(sink);
+            continue;
+        }
+
+        const bool real = pkt.content == Packet::Signal;
+        const std::size_t width = real ? 1 : 2;
+        const std::size_t count = real ? pkt.count<RealSample>() : pkt.count<Sample>();
+
+        if (count == 0)
+            continue;
+
+        // Histories never mix real and complex samples
+        if (!initialized || real != real_input) {
+            initialized = true;
+            real_input = real;
+            line.assign((length - 1)*width, 0.0f);
+            phase = 0;
+        }
+
+        auto input = source.data<RealSample>();
+        line.insert(line.end(), input, input + count*width);
+
+        auto const& re_taps = real ? bank.real_re : bank.complex_re;
+        auto const& im_taps = real ? bank.real_im : bank.complex_im;
+        const std::size_t span = length*width;
+
+        // Window ends on the sample each output is aligned to
+        const std::size_t available = line.size()/width - (length - 1);
+        const std::size_t outputs = phase < available ? (available - phase - 1)/decim + 1 : 0;
+
+        elapsed += double(pkt.duration);
+
+        if (outputs > 0) {
+            const std::uint64_t duration = std::uint64_t(elapsed) - emitted;
+            emitted += duration;
+
+            auto out = sink.buffer<Sample>(outputs);
+
+            for (std::size_t i = 0; i < outputs; ++i) {
+                const std::size_t pos = phase + i*decim;
+                auto window = line.data() + pos*width;
+
+                const Sample acc(k.dot(window, re_taps.data(), span),
+                                 k.dot(window, im_taps.data(), span));
+
+                const double angle = -2*M_PI*kfr::fract(nco + f*pos);
+                out[i] = acc*Sample(std::cos(angle), std::sin(angle));
+            }
+
+            sink.commit({ pkt.id, Packet::ComplexSignal,
+                          std::uint32_t(outputs*sizeof(Sample)), duration });
+        }
+
+        // Keep the history of the next window and the oscillator phase
+        nco = kfr::fract(nco + f*count);
+        phase = phase + outputs*decim - available;
+
+        line.erase(line.begin(), line.begin() + available*width);
+    }
+
+    return 0;
+}
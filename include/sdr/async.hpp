@@ -0,0 +1,201 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "signal.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdr
+{
+
+using PacketBuffer = std::vector<std::uint8_t, SampleAllocator<std::uint8_t>>;
+
+// Source wrapper that reads whole packets ahead on a dedicated thread.
+// Up to buffers - 1 packets are prefetched while the current one is being
+// processed; packet data stays valid until the next call to next().
+class AsyncSource {
+public:
+    explicit AsyncSource(int fd = 0, std::size_t buffers = 3);
+    AsyncSource(RawTag, Packet rawpkt, int fd = 0, std::size_t buffers = 3);
+    ~AsyncSource();
+
+    AsyncSource(AsyncSource const&) = delete;
+    AsyncSource& operator=(AsyncSource const&) = delete;
+
+    bool next();
+
+    bool end() const noexcept {
+        return eof;
+    }
+
+    Packet const& packet() const noexcept {
+        return pkt;
+    }
+
+    template<typename T = std::uint8_t>
+    T const* data() const noexcept {
+        return reinterpret_cast<T const*>(current ? current->data.data() : nullptr);
+    }
+
+    template<typename T, typename Alloc>
+    std::uint32_t recv(std::vector<T, Alloc>& data) {
+        return recv(data.data(), data.size());
+    }
+
+    template<typename T>
+    std::uint32_t recv(T* data, std::uint32_t count = 0) {
+        if (!pkt.compatible<T>())
+            return 0;
+
+        return recv(reinterpret_cast<std::uint8_t*>(data), count*sizeof(T))/sizeof(T);
+    }
+
+    std::uint32_t recv(std::uint8_t* data, std::uint32_t size = 0);
+
+    void drop() {
+        read = pkt.size;
+    }
+
+    // Forward the current packet, it must not have been read
+    void pass(Sink& sink);
+    void pass(class AsyncSink& sink);
+
+private:
+    struct Slot {
+        Packet pkt;
+        PacketBuffer data;
+    };
+
+    struct Shared {
+        Shared(Source s, Packet r, bool raw_, std::size_t buffers)
+            : source(std::move(s)), rawpkt(r), raw(raw_), slots(std::max(buffers, std::size_t(2)))
+            {}
+
+        Source source;
+        Packet rawpkt;
+        bool raw;
+
+        std::vector<Slot> slots;
+        std::size_t head = 0, tail = 0, count = 0;
+        bool eof = false, stop = false, done = false;
+
+        std::mutex lock;
+        std::condition_variable filled, freed;
+    };
+
+    static void reader(std::shared_ptr<Shared> shared);
+
+    void start();
+
+    std::shared_ptr<Shared> shared;
+    std::thread thread;
+
+    Slot* current = nullptr;
+    Packet pkt{};
+    std::uint32_t read = 0;
+    bool eof = false;
+};
+
+
+// Sink wrapper that writes packets on a dedicated thread. send() copies
+// data into one of the buffers and returns as soon as the buffer is queued;
+// buffer()/commit() let blocks compute their output in place instead.
+class AsyncSink {
+public:
+    explicit AsyncSink(int fd = 1, std::size_t buffers = 3);
+    AsyncSink(RawTag, int fd = 1, std::size_t buffers = 3);
+    ~AsyncSink();
+
+    AsyncSink(AsyncSink const&) = delete;
+    AsyncSink& operator=(AsyncSink const&) = delete;
+
+    template<typename T, typename Alloc>
+    void send(std::uint16_t id, Packet::Content content, std::vector<T, Alloc> const& data) {
+        send(id, content, 0, data);
+    }
+
+    template<typename T, typename Alloc>
+    void send(std::uint16_t id, Packet::Content content,
+              std::uint64_t duration, std::vector<T, Alloc> const& data) {
+        send({ id, content, 0, duration }, data);
+    }
+
+    template<typename T, typename Alloc>
+    void send(Packet pkt, std::vector<T, Alloc> const& data) {
+        send(pkt, data.data(), data.size());
+    }
+
+    template<typename T>
+    void send(Packet pkt, T const* data, std::uint32_t count = 0) {
+        if (count)
+            pkt.size = count*sizeof(T);
+
+        send(pkt, reinterpret_cast<std::uint8_t const*>(data));
+    }
+
+    void send(Packet pkt, std::uint8_t const* data);
+
+    // Queue data without copying, data receives a spare buffer in exchange
+    void send(Packet pkt, PacketBuffer& data);
+
+    // Writable buffer for count elements, valid until commit()
+    template<typename T>
+    T* buffer(std::uint32_t count) {
+        auto& buf = acquire();
+        buf.resize(count*sizeof(T));
+        return reinterpret_cast<T*>(buf.data());
+    }
+
+    // Queue the first pkt.size bytes of the buffer returned by buffer()
+    void commit(Packet pkt);
+
+    // Wait until all queued packets have been written
+    void flush();
+
+private:
+    struct Slot {
+        Packet pkt;
+        PacketBuffer data;
+    };
+
+    PacketBuffer& acquire();
+
+    void writer();
+
+    Sink sink;
+
+    std::vector<Slot> slots;
+    std::size_t head = 0, tail = 0, count = 0;
+    bool stop = false;
+
+    std::mutex lock;
+    std::condition_variable queued, written;
+
+    std::thread thread;
+};
+
+} /* namespace sdr */
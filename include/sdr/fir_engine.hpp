@@ -0,0 +1,51 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "kernels.hpp"
+
+#include <cstddef>
+#include <memory>
+
+namespace sdr
+{
+
+enum class FirEngine {
+    Auto,
+    Direct,
+    OverlapSave
+};
+
+struct FirChoice {
+    std::unique_ptr<kernels::Fir> fir;
+    FirEngine engine;
+
+    // Transform size for overlap-save, 0 for direct form
+    std::size_t size;
+};
+
+// FIR filter with real taps for real or complex samples. Auto times direct
+// form and overlap-save at a few transform sizes on calls of packet
+// samples, and keeps the fastest; this takes a few milliseconds. size
+// forces the overlap-save transform size when not 0.
+FirChoice make_fir(kernels::Table const& k, float const* taps, std::size_t count,
+                   bool complex, std::size_t packet,
+                   FirEngine engine = FirEngine::Auto, std::size_t size = 0);
+
+} /* namespace sdr */
@@ -0,0 +1,60 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "kfr/dsp/window.hpp"
+
+#include <cmath>
+
+namespace sdr
+{
+
+// Kaiser windowed half-band lowpass, cutoff at a quarter of the sample
+// rate and unit gain at DC. The length must be of the form 4*j + 3; taps
+// at even distances from the center are zero but the center one, 1/2.
+template<typename T>
+inline kfr::univector<T> halfband(std::size_t length, double beta) {
+    const std::size_t half = length/2;
+
+    kfr::univector<double> window(length);
+    window = kfr::window_kaiser<double>(length, beta);
+
+    kfr::univector<double> h(length);
+
+    double sum = 0.0;
+    for (std::size_t i = 0; i < length; ++i) {
+        const double k = double(i) - double(half);
+
+        if (i == half || ((half - i) & 1) == 0) {
+            h[i] = 0.0;
+        } else {
+            h[i] = std::sin(M_PI*k/2)/(M_PI*k)*window[i];
+            sum += h[i];
+        }
+    }
+
+    // Half of the gain goes through the center tap
+    kfr::univector<T> taps(length);
+    for (std::size_t i = 0; i < length; ++i)
+        taps[i] = i == half ? T(0.5) : T(0.5*h[i]/sum);
+
+    return taps;
+}
+
+} /* namespace sdr */
@@ -0,0 +1,126 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "fir_engine.hpp"
+#include "kernels.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace sdr
+{
+
+// Hilbert transformer with the taps of hilbert(). Taps at even distances
+// from the center are zero, so even and odd input samples go through
+// separate filters made of the remaining taps: each output costs half the
+// multiplications of the dense filter.
+class HilbertEngine {
+public:
+    // packet, engine and size are passed on to make_fir for both phases
+    HilbertEngine(kernels::Table const& k, std::size_t taps, bool complex,
+                  std::size_t packet, FirEngine engine = FirEngine::Auto,
+                  std::size_t size = 0);
+
+    // Outputs lag the input by this many samples
+    std::size_t delay() const noexcept {
+        return lag;
+    }
+
+    FirEngine engine() const noexcept {
+        return engine_;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    // count complex outputs: for real input the analytic signal
+    // x[n - delay] + j*H{x}[n], for complex input H{x}[n]
+    void apply(float* out, float const* in, std::size_t count);
+
+private:
+    bool complex;
+    std::size_t width;
+    std::size_t lag;
+
+    FirEngine engine_;
+    std::size_t size_;
+
+    std::unique_ptr<kernels::Fir> even, odd;
+
+    // Parity of the next input sample
+    std::size_t phase = 0;
+
+    std::vector<float> even_data, odd_data;
+
+    // Phase output held back for the next call, see the constructor
+    std::vector<float> held;
+
+    // Real input history for the in-phase part
+    std::vector<float> line;
+};
+
+// Real to complex conversion at half the rate. Mixing down by a quarter of
+// the sample rate only flips signs and zeroes alternate real and imaginary
+// parts; in the half-band decimator that follows, even input samples only
+// meet the center tap and odd ones a real filter with the remaining taps.
+// The signal at +fs/4 ends up at DC with the gain of the analytic signal.
+class Fs4Engine {
+public:
+    // taps is rounded up to the form 4*j + 3, packet, engine and size are
+    // passed on to make_fir
+    Fs4Engine(kernels::Table const& k, std::size_t taps, std::size_t packet,
+              FirEngine engine = FirEngine::Auto, std::size_t size = 0);
+
+    // Output at n matches input at 2*(n - delay)
+    std::size_t delay() const noexcept {
+        return lag;
+    }
+
+    FirEngine engine() const noexcept {
+        return engine_;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    // Up to (count + 1)/2 complex outputs, returns how many
+    std::size_t apply(float* out, float const* in, std::size_t count);
+
+private:
+    std::size_t lag;
+
+    FirEngine engine_;
+    std::size_t size_;
+
+    std::unique_ptr<kernels::Fir> fir;
+
+    // Input sample index modulo 4
+    std::size_t phase = 0;
+
+    std::vector<float> odd_data;
+
+    // Even samples for the center tap
+    std::vector<float> line;
+};
+
+} /* namespace sdr */
@@ -0,0 +1,182 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Hot DSP kernels compiled once per instruction set and selected at
+// startup from cpuid. This header must not pull in kfr: each variant is
+// built against its own renamed copy of the library.
+//
+// Complex data is passed as interleaved float pairs, so Sample buffers
+// can be handed over with a reinterpret_cast.
+
+namespace sdr
+{
+namespace kernels
+{
+
+// Stateful FIR filter with real taps; the delay line is kept across calls
+// and out may alias in
+class Fir {
+public:
+    virtual ~Fir() = default;
+
+    virtual void apply(float* out, float const* in, std::size_t count) = 0;
+};
+
+// Power-of-two DFT. Complex transforms take size() values both ways; real
+// transforms map size() reals to size()/2 + 1 complex values and back,
+// and their inverse must not run in place. Inverses are unnormalized.
+// Plans are shared by all transforms of the same size in the process and
+// large ones are persisted across runs, see plan_cache.hpp.
+class Dft {
+public:
+    virtual ~Dft() = default;
+
+    virtual std::size_t size() const noexcept = 0;
+
+    virtual void forward(float* out, float const* in) = 0;
+    virtual void inverse(float* out, float const* in) = 0;
+};
+
+// Oscillator generation methods, from most to least precise: polynomial
+// evaluation, table lookup with linear interpolation, recursive rotation
+// resynchronized to the phase accumulator every few hundred samples
+enum Oscillator {
+    Polynomial,
+    Lookup,
+    Rotation,
+    Oscillators
+};
+
+struct Table {
+    char const* arch;
+
+    // out[i] = amp*wave(phase + step*i), waves have a period of 1
+    void (*sine)(float* out, std::size_t count, float amp, float phase, float step);
+    void (*square)(float* out, std::size_t count, float amp, float phase, float step);
+    void (*triangle)(float* out, std::size_t count, float amp, float phase, float step);
+    void (*sawtooth)(float* out, std::size_t count, float amp, float phase, float step);
+
+    // out[i] = amp*exp(j*2*pi*(phase + step*i))
+    void (*cexp)(float* out, std::size_t count, float amp, float phase, float step);
+
+    // Same waves on a 64-bit phase accumulator, 2^64 being one cycle:
+    // out[i] = amp*cos(2*pi*(phase + step*i)/2^64), or amp*exp(j*...) for
+    // the complex ones; indexed by Oscillator
+    void (*oscillator[Oscillators])(float* out, std::size_t count, float amp,
+                                    std::uint64_t phase, std::uint64_t step);
+    void (*complex_oscillator[Oscillators])(float* out, std::size_t count, float amp,
+                                            std::uint64_t phase, std::uint64_t step);
+
+    // One cycle of a complex wave in 2^bits values plus a copy of the first,
+    // read on the same accumulator with linear interpolation
+    void (*complex_wavetable)(float* out, std::size_t count, float const* table,
+                              unsigned bits, float amp, std::uint64_t phase,
+                              std::uint64_t step);
+
+    // Chirps on the same accumulator, the step growing by rate every
+    // sample: out[i] = amp*cos(2*pi*(phase + step*i + rate*i*(i - 1)/2)/2^64),
+    // or amp*exp(j*...) for the complex one
+    void (*chirp)(float* out, std::size_t count, float amp, std::uint64_t phase,
+                  std::uint64_t step, std::uint64_t rate);
+    void (*complex_chirp)(float* out, std::size_t count, float amp, std::uint64_t phase,
+                          std::uint64_t step, std::uint64_t rate);
+
+    // Oscillators at arbitrary accumulator phases, for phase and frequency
+    // modulation: out[i] = amp*cos(2*pi*phases[i]/2^64), or amp*exp(j*...)
+    void (*modulate)(float* out, std::uint64_t const* phases, std::size_t count, float amp);
+    void (*complex_modulate)(float* out, std::uint64_t const* phases, std::size_t count,
+                             float amp);
+
+    // out[i] = in[i]*exp(j*2*pi*phases[i]/2^64), complex data; out may
+    // alias in
+    void (*rotate)(float* out, float const* in, std::uint64_t const* phases,
+                   std::size_t count);
+
+    // Gaussian noise of deviation sigma from a counter-based generator:
+    // out[i] only depends on key and counter + i, so a sequence can be
+    // produced in any number of pieces, on any thread, with the same result
+    void (*gaussian)(float* out, std::size_t count, float sigma,
+                     std::uint64_t key, std::uint64_t counter);
+
+    // Real to complex with zero imaginary part, and complex to real part
+    void (*widen)(float* out, float const* in, std::size_t count);
+    void (*real)(float* out, float const* in, std::size_t count);
+
+    // out[i] = re_scale*re[i] + j*im_scale*im[i]
+    void (*compose)(float* out, float const* re, float const* im, std::size_t count,
+                    float re_scale, float im_scale);
+
+    // out[i] = a[i]*b[i] with real b, a real or complex
+    void (*multiply)(float* out, float const* a, float const* b, std::size_t count);
+    void (*multiply_complex)(float* out, float const* a, float const* b, std::size_t count);
+
+    // acc[i] += (re + j*im)*in[i], complex data
+    void (*multiply_accumulate)(float* acc, float const* in, std::size_t count,
+                                float re, float im);
+
+    // Squared and plain magnitude of complex values
+    void (*power)(float* out, float const* in, std::size_t count);
+    void (*magnitude)(float* out, float const* in, std::size_t count);
+
+    // In place reductions: acc += in, acc += alpha*(in - acc), max, min
+    void (*accumulate)(float* acc, float const* in, std::size_t count);
+    void (*smooth)(float* acc, float const* in, std::size_t count, float alpha);
+    void (*maximum)(float* acc, float const* in, std::size_t count);
+    void (*minimum)(float* acc, float const* in, std::size_t count);
+
+    // out[i] = factor*in[i], sqrt(factor*in[i]), 10*log10(factor*in[i]);
+    // out may alias in
+    void (*scale)(float* out, float const* in, std::size_t count, float factor);
+    void (*root)(float* out, float const* in, std::size_t count, float factor);
+    void (*decibels)(float* out, float const* in, std::size_t count, float factor);
+
+    // Sum of a[i]*b[i], a real or complex (result in out[0], out[1]), b real
+    float (*dot)(float const* a, float const* b, std::size_t count);
+    void (*dot_complex)(float* out, float const* a, float const* b, std::size_t count);
+
+    // Real and complex data, real taps
+    std::unique_ptr<Fir> (*fir)(float const* taps, std::size_t count);
+    std::unique_ptr<Fir> (*complex_fir)(float const* taps, std::size_t count);
+
+    // Same filters by overlap-save through size-point transforms, cheaper
+    // for long filters; size must be a power of two above count, else
+    // nullptr. Output is not delayed beyond the filter's own delay.
+    std::unique_ptr<Fir> (*fast_fir)(float const* taps, std::size_t count, std::size_t size);
+    std::unique_ptr<Fir> (*fast_complex_fir)(float const* taps, std::size_t count,
+                                             std::size_t size);
+
+    // nullptr when size is not a power of two
+    std::unique_ptr<Dft> (*dft)(std::size_t size);
+    std::unique_ptr<Dft> (*real_dft)(std::size_t size);
+};
+
+// Best variant for the running cpu. SDR_KERNELS=<arch> forces a variant,
+// e.g. to compare results across instruction sets.
+Table const& active();
+
+// Variant by name, nullptr if it was not built or the cpu lacks support
+Table const* find(char const* arch);
+
+} /* namespace kernels */
+} /* namespace sdr */
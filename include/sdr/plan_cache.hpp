@@ -0,0 +1,48 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace sdr
+{
+
+// On-disk store for precomputed DFT tables (twiddles, reordering data).
+// Within a process plans are shared by the kernels themselves; this lets
+// short-lived pipelines skip table generation for large transforms.
+//
+// Tables live in $XDG_CACHE_HOME/sdr/fft (or ~/.cache/sdr/fft), one file
+// per key. Keys must identify the table layout, including the kernel
+// variant. SDR_FFT_CACHE=0 disables the store, SDR_FFT_CACHE=<dir>
+// moves it.
+class PlanCache {
+public:
+    // Smaller transforms are faster to plan than to read back
+    static constexpr std::size_t MinSize = 4096;
+
+    static bool enabled() noexcept;
+
+    // Fill data with exactly size bytes stored under key
+    static bool load(char const* key, void* data, std::size_t size) noexcept;
+
+    // Failures are silent, the cache is only an optimization
+    static void store(char const* key, void const* data, std::size_t size) noexcept;
+};
+
+} /* namespace sdr */
@@ -0,0 +1,63 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace sdr
+{
+
+// Size-class pool for sample buffers. Freed blocks are kept in small
+// per-thread caches backed by a shared free list, so buffers that are
+// resized or reallocated every packet stop hitting the system allocator
+// once the working set is warm. All blocks are 512-byte aligned.
+//
+// Blocks of 2MiB and more are mapped directly and can use huge pages,
+// selected with the SDR_HUGEPAGES environment variable (off, thp for
+// madvise(MADV_HUGEPAGE), hugetlb for MAP_HUGETLB falling back to thp).
+// Only mapped classes up to 64MiB are cached, within a total budget;
+// larger blocks are mapped at their own size and unmapped when freed.
+// Setting SDR_POOL_STATS prints counters at exit.
+class SamplePool {
+public:
+    struct Stats {
+        std::uint64_t allocations;
+        std::uint64_t deallocations;
+        std::uint64_t cache_hits;           // served from a per-thread cache
+        std::uint64_t pool_hits;            // served from the shared free list
+        std::uint64_t system_allocations;   // new memory from the system
+        std::uint64_t system_frees;
+        std::uint64_t bytes_in_use;
+        std::uint64_t bytes_reserved;       // in use plus cached
+    };
+
+    static void* allocate(std::size_t size);
+    static void deallocate(void* ptr, std::size_t size) noexcept;
+
+    static Stats stats() noexcept;
+
+    // Return all cached blocks to the system
+    static void trim() noexcept;
+};
+
+std::ostream& operator<<(std::ostream& stream, SamplePool::Stats const& stats);
+
+} /* namespace sdr */
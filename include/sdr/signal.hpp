@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "sample_pool.hpp"
 #include "stream.hpp"
 
 #include <unistd.h>
@@ -25,6 +26,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <algorithm>
+#include <cmath>
 #include <memory>
 #include <new>
 
@@ -48,15 +50,11 @@ public:
     SampleAllocator(SampleAllocator&&) noexcept = default;
 
     T* allocate(std::size_t n) const {
-        T* ptr = reinterpret_cast<T*>(aligned_alloc(512, n*sizeof(T)));
-        if (!ptr)
-            throw std::bad_alloc();
-
-        return ptr;
+        return reinterpret_cast<T*>(SamplePool::allocate(n*sizeof(T)));
     }
 
-    void deallocate(T* ptr, std::size_t) const noexcept {
-        free(ptr);
+    void deallocate(T* ptr, std::size_t n) const noexcept {
+        SamplePool::deallocate(ptr, n*sizeof(T));
     }
 
     bool operator==(SampleAllocator const&) const noexcept {
@@ -88,4 +86,21 @@ inline std::size_t optimal_block_size(std::uintmax_t element_size, std::uintmax_
     return std::size_t(size);
 }
 
+// Fraction of a cycle as an accumulator phase, 2^64 being one cycle,
+// rounded to the given number of bits
+inline std::uint64_t to_phase(double cycles, unsigned bits = 64) {
+    const double scaled = std::ldexp(cycles - std::floor(cycles), 32);
+
+    // Two halves, as doubles can't hold 64 bits
+    const double high = std::floor(scaled);
+    const std::uint64_t phase = (std::uint64_t(high) << 32) +
+                                std::uint64_t(std::llround(std::ldexp(scaled - high, 32)));
+
+    if (bits >= 64)
+        return phase;
+
+    const unsigned shift = 64 - bits;
+    return ((phase + (std::uint64_t(1) << (shift - 1))) >> shift) << shift;
+}
+
 } /* namespace sdr */
@@ -98,7 +98,7 @@ protected:
     std::uint32_t read = 0;
     bool eof = false;
 
-    std::array<std::uint8_t, sizeof(Packet)> pkt_buf;
+    std::array<std::uint8_t, sizeof(Packet)> pkt_buf{};
     std::size_t pkt_buf_pos = 0;
 
     std::vector<std::uint8_t> buffer;
@@ -140,12 +140,22 @@ public:
 
     void send(Packet pkt, std::uint8_t const* data);
 
+    // Same as send, but pipes get references to the pages of data instead
+    // of a copy: data must never change or be freed afterwards
+    template<typename T>
+    void send_shared(Packet pkt, T const* data) {
+        send_shared(pkt, reinterpret_cast<std::uint8_t const*>(data));
+    }
+
+    void send_shared(Packet pkt, std::uint8_t const* data);
+
 protected:
     friend class Source;
 
     int fd = 0;
     bool raw = false;
     bool fifo;
+    bool shared = true;
 };
 
 } /* namespace sdr */
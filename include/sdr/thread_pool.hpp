@@ -0,0 +1,177 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spinlock.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdr
+{
+
+static constexpr std::size_t NoAffinity = std::size_t(-1);
+
+class TaskGroup;
+
+// Work-stealing thread pool: each worker owns a task queue, pops its own
+// tasks LIFO and steals from the other queues FIFO when it runs dry.
+// Threads waiting on a TaskGroup execute queued tasks too, so a pool with
+// zero workers runs everything on the waiting thread.
+class ThreadPool {
+public:
+    // threads = NoAffinity picks one worker less than the hardware threads,
+    // the caller of TaskGroup::wait() takes the remaining one
+    explicit ThreadPool(std::size_t threads = NoAffinity, bool pin = false);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    // Number of threads that can run tasks concurrently, waiter included
+    std::size_t concurrency() const noexcept {
+        return workers.size() + 1;
+    }
+
+    static ThreadPool& global();
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+
+    struct Queue {
+        Spinlock lock;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task, std::size_t affinity);
+    bool run_one();
+    void work(std::size_t index, int cpu);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<std::size_t> pending{0};
+    std::atomic<std::size_t> sleeping{0};
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> stop{false};
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+};
+
+// A set of tasks that can be waited on together. The first exception
+// thrown by a task is rethrown by wait().
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool_ = ThreadPool::global()) : pool(pool_) {}
+
+    ~TaskGroup() {
+        help();
+    }
+
+    TaskGroup(TaskGroup const&) = delete;
+    TaskGroup& operator=(TaskGroup const&) = delete;
+
+    // affinity is a hint: tasks with the same value prefer the same worker
+    void run(std::function<void()> fn, std::size_t affinity = NoAffinity) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        pool.push({ std::move(fn), this }, affinity);
+    }
+
+    void wait() {
+        help();
+
+        if (error) {
+            auto e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    friend class ThreadPool;
+
+    void help();
+
+    void done(std::exception_ptr e) {
+        if (e) {
+            std::lock_guard<Spinlock> guard(error_lock);
+            if (!error)
+                error = e;
+        }
+
+        count.fetch_sub(1, std::memory_order_release);
+    }
+
+    ThreadPool& pool;
+    std::atomic<std::size_t> count{0};
+
+    Spinlock error_lock;
+    std::exception_ptr error;
+};
+
+// Split [begin, end) into chunks of a multiple of grain elements and call
+// fn(chunk_begin, chunk_end) for each one, in parallel. Chunk i always
+// gets affinity hint i, so repeated calls over the same range tend to hit
+// the same caches. Returns when all chunks are done.
+template<typename F>
+void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F&& fn,
+                  ThreadPool& pool = ThreadPool::global()) {
+    if (end <= begin)
+        return;
+
+    grain = std::max(grain, std::size_t(1));
+
+    const std::size_t grains = (end - begin + grain - 1) / grain;
+    const std::size_t chunks = std::min(grains, pool.concurrency());
+    const std::size_t chunk = ((grains + chunks - 1) / chunks) * grain;
+
+    if (chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    TaskGroup group(pool);
+
+    std::size_t i = 0, pos = begin;
+    for (; pos + chunk < end; pos += chunk, ++i) {
+        group.run([&fn,pos,chunk]() { fn(pos, pos + chunk); }, i);
+    }
+
+    // last chunk runs on the calling thread
+    fn(pos, end);
+
+    group.wait();
+}
+
+} /* namespace sdr */
@@ -0,0 +1,245 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+
+using namespace sdr;
+
+AsyncSource::AsyncSource(int fd, std::size_t buffers)
+    : shared(std::make_shared<Shared>(Source(fd), Packet(), false, buffers))
+{
+    start();
+}
+
+AsyncSource::AsyncSource(RawTag, Packet rawpkt, int fd, std::size_t buffers)
+    : shared(std::make_shared<Shared>(Source(Raw, fd), rawpkt, true, buffers))
+{
+    start();
+}
+
+AsyncSource::~AsyncSource() {
+    bool done;
+
+    {
+        std::lock_guard<std::mutex> guard(shared->lock);
+        shared->stop = true;
+        done = shared->done;
+    }
+
+    shared->freed.notify_one();
+
+    // The reader might be blocked on input, do not wait for it
+    if (done)
+        thread.join();
+    else
+        thread.detach();
+}
+
+void AsyncSource::start() {
+    thread = std::thread(reader, shared);
+}
+
+void AsyncSource::reader(std::shared_ptr<Shared> shared) {
+    auto& s = *shared;
+    const std::size_t n = s.slots.size();
+
+    for (;;) {
+        std::size_t index;
+
+        {
+            std::unique_lock<std::mutex> lock(s.lock);
+            s.freed.wait(lock, [&s,n]() { return s.stop || s.count < n; });
+
+            if (s.stop)
+                break;
+
+            index = s.tail;
+        }
+
+        // The slot is not visible to the consumer until count is updated
+        auto& slot = s.slots[index];
+
+        if (!(s.raw ? s.source.next(s.rawpkt) : s.source.next()))
+            break;
+
+        slot.pkt = s.source.packet();
+        slot.data.resize(slot.pkt.size);
+        slot.pkt.size = s.source.recv(slot.data.data(), slot.pkt.size);
+
+        {
+            std::lock_guard<std::mutex> guard(s.lock);
+            s.tail = (s.tail + 1) % n;
+            ++s.count;
+        }
+
+        s.filled.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.eof = s.done = true;
+    }
+
+    s.filled.notify_one();
+}
+
+bool AsyncSource::next() {
+    auto& s = *shared;
+    const std::size_t n = s.slots.size();
+
+    std::unique_lock<std::mutex> lock(s.lock);
+
+    if (current) {
+        current = nullptr;
+        s.head = (s.head + 1) % n;
+        --s.count;
+        s.freed.notify_one();
+    }
+
+    s.filled.wait(lock, [&s]() { return s.count || s.eof; });
+
+    read = 0;
+
+    if (!s.count) {
+        pkt = Packet();
+        eof = true;
+        return false;
+    }
+
+    current = &s.slots[s.head];
+    pkt = current->pkt;
+
+    return true;
+}
+
+std::uint32_t AsyncSource::recv(std::uint8_t* data, std::uint32_t size) {
+    if (size == 0)
+        size = pkt.size;
+
+    size = std::min(size, pkt.size - read);
+
+    if (size == 0 || !current)
+        return 0;
+
+    std::copy_n(current->data.begin() + read, size, data);
+    read += size;
+
+    return size;
+}
+
+void AsyncSource::pass(Sink& sink) {
+    if (read != 0 || !current)
+        return;
+
+    sink.send(pkt, current->data.data());
+    read = pkt.size;
+}
+
+void AsyncSource::pass(AsyncSink& sink) {
+    if (read != 0 || !current)
+        return;
+
+    // Trade buffers with the sink, the slot gets the sink's spare one
+    sink.send(pkt, current->data);
+    read = pkt.size;
+}
+
+
+AsyncSink::AsyncSink(int fd, std::size_t buffers)
+    : sink(fd), slots(std::max(buffers, std::size_t(2)))
+{
+    thread = std::thread(&AsyncSink::writer, this);
+}
+
+AsyncSink::AsyncSink(RawTag, int fd, std::size_t buffers)
+    : sink(Raw, fd), slots(std::max(buffers, std::size_t(2)))
+{
+    thread = std::thread(&AsyncSink::writer, this);
+}
+
+AsyncSink::~AsyncSink() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+
+    queued.notify_one();
+    thread.join();
+}
+
+PacketBuffer& AsyncSink::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    written.wait(guard, [this]() { return count < slots.size(); });
+    return slots[tail].data;
+}
+
+void AsyncSink::commit(Packet pkt) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto& slot = slots[tail];
+        slot.pkt = pkt;
+        slot.pkt.size = std::min(pkt.size, std::uint32_t(slot.data.size()));
+        tail = (tail + 1) % slots.size();
+        ++count;
+    }
+
+    queued.notify_one();
+}
+
+void AsyncSink::send(Packet pkt, std::uint8_t const* data) {
+    auto& buf = acquire();
+    buf.assign(data, data + pkt.size);
+    commit(pkt);
+}
+
+void AsyncSink::send(Packet pkt, PacketBuffer& data) {
+    auto& buf = acquire();
+    std::swap(buf, data);
+    commit(pkt);
+}
+
+void AsyncSink::flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    written.wait(guard, [this]() { return count == 0; });
+}
+
+void AsyncSink::writer() {
+    for (;;) {
+        Slot* slot;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            queued.wait(guard, [this]() { return count || stop; });
+
+            if (!count)
+                break;
+
+            slot = &slots[head];
+        }
+
+        sink.send(slot->pkt, slot->data.data());
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            head = (head + 1) % slots.size();
+            --count;
+        }
+
+        written.notify_all();
+    }
+}
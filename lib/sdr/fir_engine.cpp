@@ -0,0 +1,106 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fir_engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace sdr;
+
+// Largest transform worth trying, and the timing budget per candidate
+static constexpr std::size_t max_size = std::size_t(1) << 20;
+static constexpr double budget = 2e-3;
+
+static std::unique_ptr<kernels::Fir> create(kernels::Table const& k, float const* taps,
+                                            std::size_t count, bool complex,
+                                            std::size_t size) {
+    if (!size)
+        return complex ? k.complex_fir(taps, count) : k.fir(taps, count);
+
+    return complex ? k.fast_complex_fir(taps, count, size) : k.fast_fir(taps, count, size);
+}
+
+// Seconds per sample, fed with packet-sized calls
+static double measure(kernels::Fir& fir, std::vector<float>& data, std::size_t packet,
+                      bool complex) {
+    using clock = std::chrono::steady_clock;
+
+    const std::size_t width = complex ? 2 : 1;
+
+    // The first call warms caches and shared plans up
+    fir.apply(data.data(), data.data(), packet);
+
+    std::size_t samples = 0;
+    const auto start = clock::now();
+    double elapsed = 0.0;
+
+    for (int calls = 0; calls < 2 || (calls < 64 && elapsed < budget); ++calls) {
+        fir.apply(data.data(), data.data(), packet);
+        samples += packet;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    // Keep the filter's output from growing out of range across calls
+    std::fill(data.begin(), data.begin() + packet*width, 0.5f);
+
+    return elapsed / samples;
+}
+
+FirChoice sdr::make_fir(kernels::Table const& k, float const* taps, std::size_t count,
+                        bool complex, std::size_t packet, FirEngine engine, std::size_t size) {
+    std::size_t smallest = 4;
+    while (smallest <= count)
+        smallest *= 2;
+
+    if (engine == FirEngine::Direct)
+        return { create(k, taps, count, complex, 0), FirEngine::Direct, 0 };
+
+    if (engine == FirEngine::OverlapSave || size) {
+        size = size ? size : std::min(2*smallest, max_size);
+        return { create(k, taps, count, complex, size), FirEngine::OverlapSave, size };
+    }
+
+    packet = std::max(packet, std::size_t(1));
+
+    std::vector<float> data(packet*(complex ? 2 : 1), 0.5f);
+
+    FirChoice best { create(k, taps, count, complex, 0), FirEngine::Direct, 0 };
+    double best_time = measure(*best.fir, data, packet, complex);
+
+    // Blocks of at least half the transform, up to well past the packet
+    for (std::size_t n = 2*smallest; n <= max_size; n *= 2) {
+        auto fir = create(k, taps, count, complex, n);
+        if (!fir)
+            continue;
+
+        const double time = measure(*fir, data, packet, complex);
+        if (time < best_time) {
+            best = { std::move(fir), FirEngine::OverlapSave, n };
+            best_time = time;
+        }
+
+        if (n - count + 1 >= 4*packet)
+            break;
+    }
+
+    // The winner has processed test data, start from a clean state
+    best.fir = create(k, taps, count, complex, best.size);
+    return best;
+}
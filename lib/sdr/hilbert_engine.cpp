@@ -0,0 +1,166 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hilbert_engine.hpp"
+#include "halfband.hpp"
+#include "hilbert.hpp"
+
+#include <algorithm>
+
+using namespace sdr;
+
+HilbertEngine::HilbertEngine(kernels::Table const& k, std::size_t taps, bool complex,
+                             std::size_t packet, FirEngine engine, std::size_t size)
+    : complex(complex), width(complex ? 2 : 1)
+{
+    // Even counts end with a zero tap, see hilbert()
+    const std::size_t length = taps - !(taps & 1);
+    auto h = hilbert<float>(length);
+
+    const std::size_t half = length/2;
+
+    // Non-zero taps sit at odd distances from the center, i.e. at odd
+    // indices when half is even: starting from the first of them, phase
+    // outputs come one sample early and are held back by one.
+    const std::size_t first = (half + 1) & 1;
+    lag = half;
+    held.assign(first*width, 0.0f);
+
+    std::vector<float> sparse;
+    for (std::size_t i = first; i < length; i += 2)
+        sparse.push_back(h[i]);
+
+    auto choice = make_fir(k, sparse.data(), sparse.size(), complex, (packet + 1)/2,
+                           engine, size);
+    engine_ = choice.engine;
+    size_ = choice.size;
+
+    even = std::move(choice.fir);
+    odd = make_fir(k, sparse.data(), sparse.size(), complex, packet, engine_, size_).fir;
+
+    if (!complex)
+        line.assign(lag, 0.0f);
+}
+
+void HilbertEngine::apply(float* out, float const* in, std::size_t count) {
+    even_data.resize(((count + 1)/2)*width);
+    odd_data.resize(((count + 1)/2)*width);
+
+    // Split by parity, filter each phase with its own state, merge back
+    std::size_t n[2] = { 0, 0 };
+    float* data[2] = { even_data.data(), odd_data.data() };
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t p = (phase + i) & 1;
+        std::copy_n(in + i*width, width, data[p] + n[p]*width);
+        ++n[p];
+    }
+
+    even->apply(data[0], data[0], n[0]);
+    odd->apply(data[1], data[1], n[1]);
+
+    n[0] = n[1] = 0;
+
+    // Real input only fills the imaginary parts
+    const std::size_t shift = held.size()/width;
+    float* dst = complex ? out : out + 1;
+
+    float prev[2];
+    std::copy(held.begin(), held.end(), prev);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t p = (phase + i) & 1;
+        float* to = i + shift < count ? dst + 2*(i + shift) : held.data();
+
+        for (std::size_t c = 0; c < width; ++c)
+            to[c] = data[p][n[p]*width + c];
+        ++n[p];
+    }
+
+    if (shift)
+        std::copy_n(prev, width, dst);
+
+    if (!complex) {
+        line.insert(line.end(), in, in + count);
+
+        for (std::size_t i = 0; i < count; ++i)
+            out[2*i] = line[i];
+
+        line.erase(line.begin(), line.begin() + count);
+    }
+
+    phase = (phase + count) & 1;
+}
+
+Fs4Engine::Fs4Engine(kernels::Table const& k, std::size_t taps, std::size_t packet,
+                     FirEngine engine, std::size_t size) {
+    const std::size_t length = taps/4*4 + 3;
+    const std::size_t half = length/2;
+
+    // Odd distances from the center fall on even indices; doubled for the
+    // gain of the analytic signal
+    auto h = halfband<float>(length, 8.0);
+
+    std::vector<float> dense(half + 1);
+    for (std::size_t j = 0; j <= half; ++j)
+        dense[j] = 2.0f*h[2*j];
+
+    auto choice = make_fir(k, dense.data(), dense.size(), false, (packet + 1)/2, engine, size);
+    fir = std::move(choice.fir);
+    engine_ = choice.engine;
+    size_ = choice.size;
+
+    lag = (half - 1)/2;
+    line.assign(lag, 0.0f);
+}
+
+std::size_t Fs4Engine::apply(float* out, float const* in, std::size_t count) {
+    odd_data.resize((count + 1)/2);
+
+    // x[n]*exp(-j*pi*n/2): even samples are real, odd ones imaginary
+    std::size_t n = 0;
+
+    for (std::size_t i = 0; i < count; ++i) {
+        switch ((phase + i) & 3) {
+            case 0:
+                line.push_back(in[i]);
+                break;
+            case 1:
+                odd_data[n++] = -in[i];
+                break;
+            case 2:
+                line.push_back(-in[i]);
+                break;
+            case 3:
+                odd_data[n++] = in[i];
+                break;
+        }
+    }
+
+    fir->apply(odd_data.data(), odd_data.data(), n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        out[2*i] = line[i];
+        out[2*i + 1] = odd_data[i];
+    }
+
+    line.erase(line.begin(), line.begin() + n);
+    phase = (phase + count) & 3;
+
+    return n;
+}
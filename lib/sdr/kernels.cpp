@@ -0,0 +1,112 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.hpp"
+
+#include "kfr/base.hpp"
+#include "kfr/cpuid.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace sdr;
+
+#if defined(CMT_ARCH_X86)
+
+namespace sdr { namespace kernels {
+    namespace sse2  { Table const& table(); }
+    namespace sse41 { Table const& table(); }
+    namespace avx   { Table const& table(); }
+    namespace avx2  { Table const& table(); }
+} }
+
+struct Variant {
+    kfr::cpu_t cpu;
+    kernels::Table const& (*table)();
+};
+
+// Widest first
+static const Variant variants[] = {
+    { kfr::cpu_t::avx2,  kernels::avx2::table  },
+    { kfr::cpu_t::avx,   kernels::avx::table   },
+    { kfr::cpu_t::sse41, kernels::sse41::table },
+    { kfr::cpu_t::sse2,  kernels::sse2::table  },
+};
+
+static bool supported(Variant const& v) {
+    static const kfr::cpu_t cpu = kfr::get_cpu();
+
+    // The avx2 variant is also built with fma, which kfr does not detect
+    if (v.cpu == kfr::cpu_t::avx2 && !__builtin_cpu_supports("fma"))
+        return false;
+
+    return v.cpu <= cpu;
+}
+
+#else
+
+namespace sdr { namespace kernels {
+    namespace native { Table const& table(); }
+} }
+
+struct Variant {
+    kernels::Table const& (*table)();
+};
+
+static const Variant variants[] = {
+    { kernels::native::table },
+};
+
+static bool supported(Variant const&) {
+    return true;
+}
+
+#endif
+
+kernels::Table const* kernels::find(char const* arch) {
+    for (auto const& v : variants) {
+        if (!std::strcmp(v.table().arch, arch))
+            return supported(v) ? &v.table() : nullptr;
+    }
+
+    return nullptr;
+}
+
+static kernels::Table const& select() {
+    if (auto env = std::getenv("SDR_KERNELS")) {
+        if (auto table = kernels::find(env))
+            return *table;
+
+        std::cerr << "warning: kernels: '" << env
+                  << "' is not available on this cpu, using the default" << std::endl;
+    }
+
+    for (auto const& v : variants) {
+        if (supported(v))
+            return v.table();
+    }
+
+    // The narrowest variant is the build baseline
+    return variants[sizeof(variants)/sizeof(variants[0]) - 1].table();
+}
+
+kernels::Table const& kernels::active() {
+    static kernels::Table const& table = select();
+    return table;
+}
@@ -0,0 +1,990 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Built once per instruction set with SDR_KERNEL_ARCH set to its name.
+// kfr defines everything inline in headers, so each variant renames the
+// library namespaces: otherwise the linker would be free to pick inline
+// functions compiled for a wider instruction set than the host has.
+
+#ifndef SDR_KERNEL_ARCH
+#error "SDR_KERNEL_ARCH must be defined"
+#endif
+
+#include "kernels.hpp"
+#include "plan_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#define SDR_PASTE_(a, b) a##_##b
+#define SDR_PASTE(a, b) SDR_PASTE_(a, b)
+
+#define kfr SDR_PASTE(kfr, SDR_KERNEL_ARCH)
+#define cometa SDR_PASTE(cometa, SDR_KERNEL_ARCH)
+
+#include "kfr/base.hpp"
+#include "kfr/dft.hpp"
+#include "kfr/dsp/fir.hpp"
+#include "kfr/dsp/oscillators.hpp"
+
+namespace sdr
+{
+namespace kernels
+{
+namespace SDR_KERNEL_ARCH
+{
+
+using Complex = kfr::complex<float>;
+
+static inline kfr::univector<float, 0> reals(float* data, std::size_t count) {
+    return kfr::make_univector(data, count);
+}
+
+static inline kfr::univector<const float, 0> reals(float const* data, std::size_t count) {
+    return kfr::make_univector(data, count);
+}
+
+static inline kfr::univector<Complex, 0> complexes(float* data, std::size_t count) {
+    return kfr::make_univector(reinterpret_cast<Complex*>(data), count);
+}
+
+static inline kfr::univector<const Complex, 0> complexes(float const* data, std::size_t count) {
+    return kfr::make_univector(reinterpret_cast<Complex const*>(data), count);
+}
+
+// Native vectors, loaded and stored whole: kfr::read and kfr::write copy
+// element by element, which GCC may turn into narrow stores followed by a
+// wide reload, stalling on store forwarding
+using Native = kfr::vec<float, kfr::platform<float>::vector_width>;
+
+static inline Native load(float const* src) {
+    Native::simd_type simd;
+    std::memcpy(&simd, src, sizeof(simd));
+    return simd;
+}
+
+static inline void store(float* dst, Native const& v) {
+    const Native::simd_type simd = *v;
+    std::memcpy(dst, &simd, sizeof(simd));
+}
+
+static void sine(float* out, std::size_t count, float amp, float phase, float step) {
+    reals(out, count) = amp*kfr::sinenorm(phase + step*kfr::counter());
+}
+
+static void square(float* out, std::size_t count, float amp, float phase, float step) {
+    reals(out, count) = amp*kfr::squarenorm(phase + step*kfr::counter());
+}
+
+static void triangle(float* out, std::size_t count, float amp, float phase, float step) {
+    reals(out, count) = amp*kfr::trianglenorm(phase + step*kfr::counter());
+}
+
+static void sawtooth(float* out, std::size_t count, float amp, float phase, float step) {
+    reals(out, count) = amp*kfr::sawtoothnorm(phase + step*kfr::counter());
+}
+
+static void cexp(float* out, std::size_t count, float amp, float phase, float step) {
+    const Complex j2pi = { 0, kfr::constants<float>::pi_s(2) };
+    complexes(out, count) = amp*kfr::cexp(j2pi * (phase + step*kfr::counter()));
+}
+
+// Oscillators work in chunks: accumulator phases are rounded to signed
+// 32-bit fractions of a cycle, then turned into floats in [-0.5, 0.5).
+// Precision never degrades with the length of the run.
+static constexpr std::size_t osc_chunk = 256;
+static constexpr std::size_t osc_width = kfr::platform<float>::vector_width;
+
+static inline float osc_cycles(std::uint64_t phase) {
+    const std::int32_t fraction = std::int32_t(std::uint32_t((phase + 0x80000000u) >> 32));
+    return float(fraction)*(1.0f/4294967296.0f);
+}
+
+static inline std::uint64_t osc_phases(float* x, std::size_t count,
+                                       std::uint64_t phase, std::uint64_t step) {
+    for (std::size_t i = 0; i < count; ++i, phase += step)
+        x[i] = osc_cycles(phase);
+
+    return phase;
+}
+
+// Second-order accumulator, the step growing by rate every sample.
+// Groups of osc_width lanes take fixed offsets from the first phase of
+// the group, so the loop vectorizes; phase and step are left at the end
+// of the run. Per-lane recurrences were miscompiled by GCC 12 at -O3.
+static inline void osc_chirp_phases(float* x, std::size_t count, std::uint64_t& phase,
+                                    std::uint64_t& step, std::uint64_t rate) {
+    constexpr std::size_t w = osc_width;
+    std::uint64_t offsets[w];
+
+    for (std::size_t l = 0; l < w; ++l)
+        offsets[l] = l*step + (l*(l - 1)/2)*rate;
+
+    std::size_t i = 0;
+    for (; i + w <= count; i += w) {
+        for (std::size_t l = 0; l < w; ++l)
+            x[i + l] = osc_cycles(phase + offsets[l]);
+
+        phase += w*step + (w*(w - 1)/2)*rate;
+        step += w*rate;
+        for (std::size_t l = 0; l < w; ++l)
+            offsets[l] += l*w*rate;
+    }
+    for (; i < count; ++i) {
+        x[i] = osc_cycles(phase);
+        phase += step;
+        step += rate;
+    }
+}
+
+// cos(2*pi*x) for x in [-0.5, 0.5], as -sin(2*pi*(|x| - 1/4)) by its
+// Taylor series up to the 11th power: the truncation error stays below
+// 6e-8 on the reduced range, under float rounding. Forced inline, as the
+// compiler gives up on it in the larger loops.
+template<std::size_t w>
+__attribute__((always_inline)) static inline kfr::vec<float, w> osc_cos(kfr::vec<float, w> x) {
+    const kfr::vec<float, w> u = (kfr::abs(x) - 0.25f)*float(2*M_PI);
+    const kfr::vec<float, w> u2 = u*u;
+
+    kfr::vec<float, w> p = u2*float(-1.0/39916800) + float(1.0/362880);
+    p = p*u2 + float(-1.0/5040);
+    p = p*u2 + float(1.0/120);
+    p = p*u2 + float(-1.0/6);
+    p = p*u2 + 1.0f;
+
+    return -(p*u);
+}
+
+// Interleaved cos and sin of the same phases, as cos(2*pi*(x - 1/4)) in
+// the odd lanes; shift holds 0 in even lanes and 1/4 in odd ones
+template<std::size_t w>
+__attribute__((always_inline)) static inline kfr::vec<float, w> osc_cossin(kfr::vec<float, w> x,
+                                            kfr::vec<float, w> const& shift) {
+    const kfr::vec<float, w> y = x - shift;
+    return osc_cos(kfr::select(y < -0.5f, y + 1.0f, y));
+}
+
+static void chirp(float* out, std::size_t count, float amp,
+                  std::uint64_t phase, std::uint64_t step, std::uint64_t rate) {
+    constexpr std::size_t w = osc_width;
+    const kfr::vec<float, w> gain = amp;
+    alignas(64) float x[osc_chunk];
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+        osc_chirp_phases(x, n, phase, step, rate);
+
+        std::size_t i = 0;
+        for (; i + w <= n; i += w)
+            store(out + pos + i, gain*osc_cos(load(x + i)));
+        for (; i < n; ++i)
+            out[pos + i] = amp*std::cos(float(2*M_PI)*x[i]);
+    }
+}
+
+static void complex_chirp(float* out, std::size_t count, float amp,
+                          std::uint64_t phase, std::uint64_t step, std::uint64_t rate) {
+    constexpr std::size_t w = osc_width;
+    const kfr::vec<float, w> gain = amp;
+    alignas(64) float x[osc_chunk];
+
+    kfr::vec<float, w> shift;
+    for (std::size_t l = 0; l < w; ++l)
+        shift[l] = (l & 1) ? 0.25f : 0.0f;
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+        osc_chirp_phases(x, n, phase, step, rate);
+
+        // Even lanes take the cosine, odd lanes the sine of the same phase
+        auto dst = out + 2*pos;
+        std::size_t i = 0;
+        for (; i + w <= n; i += w) {
+            const auto v = load(x + i);
+            store(dst + 2*i, gain*osc_cossin(kfr::dup(kfr::low(v)), shift));
+            store(dst + 2*i + w, gain*osc_cossin(kfr::dup(kfr::high(v)), shift));
+        }
+        for (; i < n; ++i) {
+            dst[2*i] = amp*std::cos(float(2*M_PI)*x[i]);
+            dst[2*i + 1] = amp*std::sin(float(2*M_PI)*x[i]);
+        }
+    }
+}
+
+// Constant frequency is a chirp of zero rate
+static void osc_polynomial(float* out, std::size_t count, float amp,
+                           std::uint64_t phase, std::uint64_t step) {
+    chirp(out, count, amp, phase, step, 0);
+}
+
+static void complex_osc_polynomial(float* out, std::size_t count, float amp,
+                                   std::uint64_t phase, std::uint64_t step) {
+    complex_chirp(out, count, amp, phase, step, 0);
+}
+
+// One cycle of cosine, plus a guard entry for interpolation
+static constexpr std::size_t osc_table_bits = 12;
+
+static float const* osc_table() {
+    static const std::vector<float> table = []() {
+        const std::size_t n = std::size_t(1) << osc_table_bits;
+        std::vector<float> t(n + 1);
+        for (std::size_t i = 0; i <= n; ++i)
+            t[i] = float(std::cos(2*M_PI*double(i)/n));
+        return t;
+    }();
+
+    return table.data();
+}
+
+static inline float lookup_cos(float const* table, std::uint64_t phase) {
+    // Table index from the top bits, 24 bits of fraction from the next ones
+    const std::size_t index = std::size_t(phase >> (64 - osc_table_bits));
+    const float fraction = float(std::uint32_t((phase << osc_table_bits) >> 40))*(1.0f/16777216.0f);
+
+    return table[index] + fraction*(table[index + 1] - table[index]);
+}
+
+static void osc_lookup(float* out, std::size_t count, float amp,
+                       std::uint64_t phase, std::uint64_t step) {
+    auto table = osc_table();
+
+    for (std::size_t i = 0; i < count; ++i, phase += step)
+        out[i] = amp*lookup_cos(table, phase);
+}
+
+static void complex_osc_lookup(float* out, std::size_t count, float amp,
+                               std::uint64_t phase, std::uint64_t step) {
+    auto table = osc_table();
+
+    // sin(x) = cos(x - pi/2)
+    constexpr std::uint64_t quarter = std::uint64_t(1) << 62;
+
+    for (std::size_t i = 0; i < count; ++i, phase += step) {
+        out[2*i] = amp*lookup_cos(table, phase);
+        out[2*i + 1] = amp*lookup_cos(table, phase - quarter);
+    }
+}
+
+static void complex_wavetable(float* out, std::size_t count, float const* table,
+                              unsigned bits, float amp, std::uint64_t phase,
+                              std::uint64_t step) {
+    for (std::size_t i = 0; i < count; ++i, phase += step) {
+        const std::size_t index = std::size_t(phase >> (64 - bits));
+        const float fraction = float(std::uint32_t((phase << bits) >> 40))*(1.0f/16777216.0f);
+
+        auto t = table + 2*index;
+        out[2*i] = amp*(t[0] + fraction*(t[2] - t[0]));
+        out[2*i + 1] = amp*(t[1] + fraction*(t[3] - t[1]));
+    }
+}
+
+// Angle of step*count in radians, wrapped to [-pi, pi)
+static inline double osc_angle(std::uint64_t step, std::size_t count) {
+    return double(std::int64_t(step*count))*(2*M_PI/18446744073709551616.0);
+}
+
+// Chebyshev recurrence cos(x + w*d) = 2*cos(w*d)*cos(x) - cos(x - w*d) on w
+// lanes at once
+static void osc_rotation(float* out, std::size_t count, float amp,
+                         std::uint64_t phase, std::uint64_t step) {
+    constexpr std::size_t w = osc_width;
+    const kfr::vec<float, w> gain = amp;
+    alignas(64) float x[2*w];
+    alignas(64) float tail[w];
+
+    const kfr::vec<float, w> twice = float(2*std::cos(osc_angle(step, w)));
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+
+        osc_phases(x, 2*w, phase - w*step, step);
+        phase += n*step;
+
+        auto prev = gain*osc_cos(load(x));
+        auto cur = gain*osc_cos(load(x + w));
+
+        std::size_t i = 0;
+        for (; i + w <= n; i += w) {
+            store(out + pos + i, cur);
+
+            const auto next = twice*cur - prev;
+            prev = cur;
+            cur = next;
+        }
+
+        if (i < n) {
+            store(tail, cur);
+            std::copy(tail, tail + (n - i), out + pos + i);
+        }
+    }
+}
+
+// Complex lanes multiplied by exp(j*w/2*d) at each step
+static void complex_osc_rotation(float* out, std::size_t count, float amp,
+                                 std::uint64_t phase, std::uint64_t step) {
+    constexpr std::size_t w = osc_width;
+    const kfr::vec<float, w> gain = amp;
+    constexpr std::size_t lanes = w/2;
+    alignas(64) float x[w];
+    alignas(64) float tail[w];
+
+    const double angle = osc_angle(step, lanes);
+    const float c = float(std::cos(angle)), sn = float(std::sin(angle));
+
+    // (re, im)*(c + j*sn) = re*c - im*sn + j*(im*c + re*sn)
+    kfr::vec<float, w> rot_re, rot_im, shift;
+    for (std::size_t l = 0; l < w; ++l) {
+        rot_re[l] = c;
+        rot_im[l] = (l & 1) ? sn : -sn;
+        shift[l] = (l & 1) ? 0.25f : 0.0f;
+    }
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+
+        osc_phases(x, lanes, phase, step);
+        phase += n*step;
+
+        auto z = gain*osc_cossin(kfr::dup(kfr::read<lanes, true>(x)), shift);
+
+        auto dst = out + 2*pos;
+        std::size_t i = 0;
+        for (; i + lanes <= n; i += lanes) {
+            store(dst + 2*i, z);
+            z = z*rot_re + kfr::swap<2>(z)*rot_im;
+        }
+
+        if (i < n) {
+            store(tail, z);
+            std::copy(tail, tail + 2*(n - i), dst + 2*i);
+        }
+    }
+}
+
+// Cosines and interleaved cosines and sines of arbitrary accumulator
+// phases, count at most osc_chunk. Short ends are padded to full vectors,
+// so results never depend on where a run is split.
+static void osc_turns(float* out, std::uint64_t const* phases, std::size_t count,
+                      float amp, bool complex) {
+    constexpr std::size_t w = osc_width;
+    const kfr::vec<float, w> gain = amp;
+    alignas(64) float x[osc_chunk];
+
+    kfr::vec<float, w> shift;
+    for (std::size_t l = 0; l < w; ++l)
+        shift[l] = (l & 1) ? 0.25f : 0.0f;
+
+    const std::size_t padded = (count + w - 1)/w*w;
+    for (std::size_t i = 0; i < count; ++i)
+        x[i] = osc_cycles(phases[i]);
+    std::fill(x + count, x + padded, 0.0f);
+
+    for (std::size_t i = 0; i < padded; i += w) {
+        const auto v = load(x + i);
+        if (complex) {
+            store(out + 2*i, gain*osc_cossin(kfr::dup(kfr::low(v)), shift));
+            store(out + 2*i + w, gain*osc_cossin(kfr::dup(kfr::high(v)), shift));
+        } else {
+            store(out + i, gain*osc_cos(v));
+        }
+    }
+}
+
+static void modulate(float* out, std::uint64_t const* phases, std::size_t count, float amp) {
+    alignas(64) float turn[osc_chunk];
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+        osc_turns(turn, phases + pos, n, amp, false);
+        std::copy_n(turn, n, out + pos);
+    }
+}
+
+static void complex_modulate(float* out, std::uint64_t const* phases, std::size_t count,
+                             float amp) {
+    alignas(64) float turn[2*osc_chunk];
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+        osc_turns(turn, phases + pos, n, amp, true);
+        std::copy_n(turn, 2*n, out + 2*pos);
+    }
+}
+
+// out[i] = in[i]*exp(j*2*pi*phases[i]/2^64)
+static void rotate(float* out, float const* in, std::uint64_t const* phases,
+                   std::size_t count) {
+    alignas(64) float turn[2*osc_chunk];
+
+    for (std::size_t pos = 0; pos < count; pos += osc_chunk) {
+        const std::size_t n = std::min(count - pos, osc_chunk);
+        osc_turns(turn, phases + pos, n, 1.0f, true);
+        complexes(out + 2*pos, n) = complexes(in + 2*pos, n)*complexes(turn, n);
+    }
+}
+
+// SplitMix64 as a counter-based generator: 64 bits for each index, made
+// of a 24-bit uniform in (0, 1) and a 32-bit phase in [-0.5, 0.5)
+static inline std::uint64_t noise_bits(std::uint64_t key, std::uint64_t index) {
+    std::uint64_t z = key + index*0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Natural logarithm of m*2^e for m in [sqrt(1/2), sqrt(2)], by the
+// series 2*atanh(s) with s = (m - 1)/(m + 1), |s| < 0.172: the first five
+// terms are exact to float precision
+template<std::size_t w>
+static inline kfr::vec<float, w> noise_log(kfr::vec<float, w> m, kfr::vec<float, w> e) {
+    const kfr::vec<float, w> s = (m - 1.0f)/(m + 1.0f);
+    const kfr::vec<float, w> s2 = s*s;
+
+    kfr::vec<float, w> p = s2*float(2.0/9) + float(2.0/7);
+    p = p*s2 + float(2.0/5);
+    p = p*s2 + float(2.0/3);
+    p = p*s2 + 2.0f;
+
+    return p*s + e*float(M_LN2);
+}
+
+// Box-Muller: each index gives the pair r*cos(2*pi*x), r*sin(2*pi*x),
+// written to out; count is at most osc_chunk. Short ends are padded as
+// in rotate().
+static void noise_pairs(float* out, std::size_t count, float scale,
+                        std::uint64_t key, std::uint64_t index) {
+    constexpr std::size_t w = osc_width;
+    alignas(64) float m[osc_chunk];
+    alignas(64) float e[osc_chunk];
+    alignas(64) float x[osc_chunk];
+    alignas(64) float values[2*osc_chunk];
+
+    kfr::vec<float, w> shift;
+    for (std::size_t l = 0; l < w; ++l)
+        shift[l] = (l & 1) ? 0.25f : 0.0f;
+
+    const std::size_t padded = (count + w - 1)/w*w;
+    for (std::size_t i = 0; i < padded; ++i) {
+        const std::uint64_t bits = noise_bits(key, index + i);
+        x[i] = float(std::int32_t(std::uint32_t(bits >> 32)))*(1.0f/4294967296.0f);
+
+        // Uniform in (0, 1), split into mantissa and exponent for the log
+        const float u = (float(std::uint32_t(bits) >> 8) + 0.5f)*(1.0f/16777216.0f);
+        std::uint32_t ub;
+        std::memcpy(&ub, &u, sizeof(ub));
+
+        const bool high = (ub & 0x7fffffu) > 0x3504f3u;
+        const std::uint32_t mb = (ub & 0x7fffffu) | (high ? 0x3f000000u : 0x3f800000u);
+        std::memcpy(&m[i], &mb, sizeof(mb));
+        e[i] = float(int(ub >> 23) - (high ? 126 : 127));
+    }
+
+    const bool direct = count == padded;
+    float* dst = direct ? out : values;
+
+    for (std::size_t i = 0; i < padded; i += w) {
+        const auto r = kfr::sqrt(noise_log(load(m + i), load(e + i))*scale);
+        const auto v = load(x + i);
+        store(dst + 2*i, kfr::dup(kfr::low(r))*osc_cossin(kfr::dup(kfr::low(v)), shift));
+        store(dst + 2*i + w, kfr::dup(kfr::high(r))*osc_cossin(kfr::dup(kfr::high(v)), shift));
+    }
+
+    if (!direct)
+        std::copy_n(values, 2*count, out);
+}
+
+// Values 2*i and 2*i + 1 of the sequence come from pair i
+static void gaussian(float* out, std::size_t count, float sigma,
+                     std::uint64_t key, std::uint64_t counter) {
+    const float scale = -2.0f*sigma*sigma;
+    float pair[2];
+
+    // Odd ends take one half of a pair
+    if (count > 0 && (counter & 1)) {
+        noise_pairs(pair, 1, scale, key, counter >> 1);
+        *out++ = pair[1];
+        --count;
+        ++counter;
+    }
+
+    const std::size_t pairs = count/2;
+    const std::uint64_t index = counter >> 1;
+
+    for (std::size_t pos = 0; pos < pairs; pos += osc_chunk)
+        noise_pairs(out + 2*pos, std::min(pairs - pos, osc_chunk), scale, key, index + pos);
+
+    if (count & 1) {
+        noise_pairs(pair, 1, scale, key, index + pairs);
+        out[count - 1] = pair[0];
+    }
+}
+
+// acc[i] += (re + j*im)*in[i]
+static void multiply_accumulate(float* acc, float const* in, std::size_t count,
+                                float re, float im) {
+    complexes(acc, count) = complexes(acc, count) + complexes(in, count)*Complex(re, im);
+}
+
+static void widen(float* out, float const* in, std::size_t count) {
+    // Plain loop: the compiler interleaves whole vectors with zeros, where
+    // kfr converts element by element
+    for (std::size_t i = 0; i < count; ++i) {
+        out[2*i] = in[i];
+        out[2*i + 1] = 0.0f;
+    }
+}
+
+static void real(float* out, float const* in, std::size_t count) {
+    reals(out, count) = kfr::real(complexes(in, count));
+}
+
+static void compose(float* out, float const* re, float const* im, std::size_t count,
+                    float re_scale, float im_scale) {
+    for (std::size_t i = 0; i < count; ++i) {
+        out[2*i] = re_scale*re[i];
+        out[2*i + 1] = im_scale*im[i];
+    }
+}
+
+static void multiply(float* out, float const* a, float const* b, std::size_t count) {
+    reals(out, count) = reals(a, count)*reals(b, count);
+}
+
+static void multiply_complex(float* out, float const* a, float const* b, std::size_t count) {
+    complexes(out, count) = complexes(a, count)*reals(b, count);
+}
+
+static void power(float* out, float const* in, std::size_t count) {
+    reals(out, count) = kfr::sqr(kfr::real(complexes(in, count))) +
+                        kfr::sqr(kfr::imag(complexes(in, count)));
+}
+
+static void magnitude(float* out, float const* in, std::size_t count) {
+    reals(out, count) = kfr::cabs(complexes(in, count));
+}
+
+static void accumulate(float* acc, float const* in, std::size_t count) {
+    reals(acc, count) = reals(acc, count) + reals(in, count);
+}
+
+static void smooth(float* acc, float const* in, std::size_t count, float alpha) {
+    reals(acc, count) = reals(acc, count) + alpha*(reals(in, count) - reals(acc, count));
+}
+
+static void maximum(float* acc, float const* in, std::size_t count) {
+    reals(acc, count) = kfr::max(reals(acc, count), reals(in, count));
+}
+
+static void minimum(float* acc, float const* in, std::size_t count) {
+    reals(acc, count) = kfr::min(reals(acc, count), reals(in, count));
+}
+
+static void scale(float* out, float const* in, std::size_t count, float factor) {
+    reals(out, count) = factor*reals(in, count);
+}
+
+static void root(float* out, float const* in, std::size_t count, float factor) {
+    reals(out, count) = kfr::sqrt(factor*reals(in, count));
+}
+
+static void decibels(float* out, float const* in, std::size_t count, float factor) {
+    // Clamped at -300 dB so empty bins stay finite
+    reals(out, count) = 10.0f*kfr::log10(kfr::max(factor*reals(in, count), 1e-30f));
+}
+
+static float dot(float const* a, float const* b, std::size_t count) {
+    return kfr::dotproduct(reals(a, count), reals(b, count));
+}
+
+static void dot_complex(float* out, float const* a, float const* b, std::size_t count) {
+    // Native width only, wider vectors go through memory with some compilers
+    constexpr std::size_t w = kfr::platform<float>::vector_width;
+
+    kfr::vec<float, w> acc0 = 0.0f, acc1 = 0.0f;
+
+    std::size_t i = 0;
+    for (; i + w <= count; i += w) {
+        const auto taps = load(b + i);
+        acc0 += load(a + 2*i)*kfr::dup(kfr::low(taps));
+        acc1 += load(a + 2*i + w)*kfr::dup(kfr::high(taps));
+    }
+
+    acc0 += acc1;
+    float re = kfr::hadd(kfr::even(acc0)), im = kfr::hadd(kfr::odd(acc0));
+
+    for (; i < count; ++i) {
+        re += a[2*i]*b[i];
+        im += a[2*i + 1]*b[i];
+    }
+
+    out[0] = re;
+    out[1] = im;
+}
+
+template<typename U>
+class KfrFir : public Fir {
+public:
+    KfrFir(float const* taps, std::size_t count)
+        : state(kfr::make_univector(taps, count))
+        {}
+
+    void apply(float* out, float const* in, std::size_t count) override {
+        auto output = kfr::make_univector(reinterpret_cast<U*>(out), count);
+        output = kfr::fir(state, kfr::make_univector(reinterpret_cast<U const*>(in), count));
+    }
+
+private:
+    kfr::fir_state<float, U> state;
+};
+
+static std::unique_ptr<Fir> fir(float const* taps, std::size_t count) {
+    return std::unique_ptr<Fir>(new KfrFir<float>(taps, count));
+}
+
+static std::unique_ptr<Fir> complex_fir(float const* taps, std::size_t count) {
+    return std::unique_ptr<Fir>(new KfrFir<Complex>(taps, count));
+}
+
+// Cache key for the tables of a transform, they depend on kfr's version,
+// the vector width and the plan layout
+static void cache_key(char* key, std::size_t len, char const* kind, std::size_t size) {
+    std::snprintf(key, len, "kfr%s-%s-%s-f32-%zu",
+                  KFR_VERSION_STRING, CMT_STRINGIFY(SDR_KERNEL_ARCH), kind, size);
+}
+
+// dft_plan computes its tables in the constructor: Plan starts from a
+// trivial plan and rebuilds the stages itself, so that the tables can be
+// read back from the plan cache instead.
+class Plan : public kfr::dft_plan<float> {
+public:
+    explicit Plan(std::size_t n) : kfr::dft_plan<float>(2) {
+        using namespace kfr;
+
+        stages[0].clear();
+        stages[1].clear();
+        this->size = n;
+        this->temp_size = 0;
+        this->data_size = 0;
+
+        // Same stages as the dft_plan constructor
+        const std::size_t log2n = ilog2(n);
+        cswitch(csizes_t<1, 2, 3, 4, 5, 6, 7, 8>(), log2n,
+                [&](auto log2n) {
+                    (void)log2n;
+                    this->add_stage<internal::fft_specialization_t<float, val_of(decltype(log2n)()),
+                                                                   false>::template type>(n, dft_type::both);
+                },
+                [&]() {
+                    cswitch(cfalse_true, is_even(log2n), [&](auto is_even) {
+                        this->make_fft(n, dft_type::both, is_even, ctrue);
+                        this->add_stage<internal::fft_reorder_stage_impl_t<
+                            float, val_of(decltype(is_even)())>::template type>(n, dft_type::both);
+                    });
+                });
+
+        char key[128];
+        cache_key(key, sizeof(key), "dft", n);
+
+        const bool persistent = n >= PlanCache::MinSize;
+
+        autofree<u8> tables(this->data_size);
+        if (persistent && PlanCache::load(key, tables.data(), this->data_size)) {
+            this->data = std::move(tables);
+
+            // Same layout as dft_plan::initialize, directions share tables
+            for (auto& dir : stages) {
+                std::size_t offset = 0;
+                for (auto& stage : dir) {
+                    stage->data = this->data.data() + offset;
+                    offset += stage->data_size;
+                }
+            }
+        } else {
+            this->initialize(dft_type::both);
+
+            if (persistent)
+                PlanCache::store(key, this->data.data(), this->data_size);
+        }
+    }
+};
+
+static inline Complex conj(Complex c) {
+    return Complex(c.real(), -c.imag());
+}
+
+// Real transforms run a complex transform of half the size on the even
+// and odd samples, then split the result with these twiddles
+struct RealPlan {
+    explicit RealPlan(std::size_t n)
+        : half(shared_plan<Plan>(n/2)), twiddle(n/4 + 1)
+    {
+        char key[128];
+        cache_key(key, sizeof(key), "rdft", n);
+
+        const bool persistent = n >= PlanCache::MinSize;
+        const std::size_t bytes = twiddle.size()*sizeof(Complex);
+
+        if (persistent && PlanCache::load(key, twiddle.data(), bytes))
+            return;
+
+        for (std::size_t k = 0; k < twiddle.size(); ++k) {
+            const double phi = -2*kfr::c_pi<double>*double(k)/double(n);
+            twiddle[k] = Complex(float(std::cos(phi)), float(std::sin(phi)));
+        }
+
+        if (persistent)
+            PlanCache::store(key, twiddle.data(), bytes);
+    }
+
+    template<typename P>
+    static std::shared_ptr<const P> shared_plan(std::size_t n) {
+        static std::mutex lock;
+        static std::map<std::size_t, std::shared_ptr<const P>> plans;
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto& plan = plans[n];
+        if (!plan)
+            plan = std::make_shared<const P>(n);
+
+        return plan;
+    }
+
+    std::shared_ptr<const Plan> half;
+    kfr::univector<Complex> twiddle;
+};
+
+class ComplexDft : public Dft {
+public:
+    explicit ComplexDft(std::size_t size)
+        : plan(RealPlan::shared_plan<Plan>(size)), temp(plan->temp_size)
+        {}
+
+    std::size_t size() const noexcept override {
+        return plan->size;
+    }
+
+    void forward(float* out, float const* in) override {
+        plan->execute(reinterpret_cast<Complex*>(out), reinterpret_cast<Complex const*>(in),
+                      temp.data(), false);
+    }
+
+    void inverse(float* out, float const* in) override {
+        plan->execute(reinterpret_cast<Complex*>(out), reinterpret_cast<Complex const*>(in),
+                      temp.data(), true);
+    }
+
+private:
+    std::shared_ptr<const Plan> plan;
+    kfr::univector<kfr::u8> temp;
+};
+
+class RealDft : public Dft {
+public:
+    explicit RealDft(std::size_t size)
+        : plan(RealPlan::shared_plan<RealPlan>(size)), n(size), temp(plan->half->temp_size)
+        {}
+
+    std::size_t size() const noexcept override {
+        return n;
+    }
+
+    void forward(float* out, float const* in) override {
+        const std::size_t m = n/2;
+        auto z = reinterpret_cast<Complex*>(out);
+        auto w = plan->twiddle.data();
+
+        plan->half->execute(z, reinterpret_cast<Complex const*>(in), temp.data(), false);
+
+        const Complex z0 = z[0];
+        z[0] = Complex(z0.real() + z0.imag(), 0);
+        z[m] = Complex(z0.real() - z0.imag(), 0);
+
+        for (std::size_t k = 1; k <= m/2; ++k) {
+            const Complex a = z[k], b = conj(z[m - k]);
+            const Complex even = (a + b)*0.5f;
+            const Complex odd = w[k]*((a - b)*Complex(0, -0.5f));
+
+            z[k] = even + odd;
+            z[m - k] = conj(even - odd);
+        }
+    }
+
+    // out must not alias in
+    void inverse(float* out, float const* in) override {
+        const std::size_t m = n/2;
+        auto x = reinterpret_cast<Complex const*>(in);
+        auto z = reinterpret_cast<Complex*>(out);
+        auto w = plan->twiddle.data();
+
+        z[0] = Complex(x[0].real() + x[m].real(), x[0].real() - x[m].real());
+
+        for (std::size_t k = 1; k <= m/2; ++k) {
+            const Complex a = x[k], b = conj(x[m - k]);
+            const Complex even = a + b;
+            const Complex odd = Complex(0, 1)*((a - b)*conj(w[k]));
+
+            z[k] = even + odd;
+            z[m - k] = conj(even - odd);
+        }
+
+        plan->half->execute(z, z, temp.data(), true);
+    }
+
+private:
+    std::shared_ptr<const RealPlan> plan;
+    std::size_t n;
+    kfr::univector<kfr::u8> temp;
+};
+
+// Overlap-save with zero latency: the block being filled is transformed
+// again on every call, so samples come out as soon as they come in. Each
+// block of size - count + 1 samples is complete after one transform when
+// calls are at least that long.
+template<typename U, typename Transform>
+class FastFir : public Fir {
+public:
+    FastFir(float const* taps, std::size_t count, std::size_t size)
+        : transform(size), history(count - 1), block(size - count + 1),
+          window(size, U(0)), result(size), spectrum(size/2 + 1), response(size/2 + 1)
+    {
+        // Spectra of real transforms are half size, complex ones need all bins
+        if (std::is_same<U, Complex>::value) {
+            spectrum.resize(size);
+            response.resize(size);
+        }
+
+        kfr::univector<U> padded(size, U(0));
+        std::copy_n(taps, count, padded.begin());
+
+        auto resp = reinterpret_cast<float*>(response.data());
+        transform.forward(resp, reinterpret_cast<float const*>(padded.data()));
+
+        // Inverse transforms are unnormalized
+        response = response*(1.0f/size);
+    }
+
+    void apply(float* out, float const* in, std::size_t count) override {
+        auto input = reinterpret_cast<U const*>(in);
+        auto output = reinterpret_cast<U*>(out);
+
+        for (std::size_t pos = 0; pos < count; ) {
+            const std::size_t take = std::min(count - pos, block - fill);
+            const std::size_t start = history + fill;
+
+            std::copy_n(input + pos, take, window.begin() + start);
+
+            transform.forward(reinterpret_cast<float*>(spectrum.data()),
+                              reinterpret_cast<float const*>(window.data()));
+            spectrum = spectrum*response;
+            transform.inverse(reinterpret_cast<float*>(result.data()),
+                              reinterpret_cast<float const*>(spectrum.data()));
+
+            std::copy_n(result.begin() + start, take, output + pos);
+
+            fill += take;
+            pos += take;
+
+            if (fill == block) {
+                std::copy_n(window.begin() + block, history, window.begin());
+                std::fill(window.begin() + history, window.end(), U(0));
+                fill = 0;
+            }
+        }
+    }
+
+private:
+    Transform transform;
+    const std::size_t history;
+    const std::size_t block;
+    std::size_t fill = 0;
+
+    kfr::univector<U> window;
+    kfr::univector<U> result;
+    kfr::univector<Complex> spectrum;
+    kfr::univector<Complex> response;
+};
+
+static std::unique_ptr<Fir> fast_fir(float const* taps, std::size_t count, std::size_t size) {
+    if (count < 1 || size < 4 || size <= count || !kfr::is_poweroftwo(size))
+        return nullptr;
+
+    return std::unique_ptr<Fir>(new FastFir<float, RealDft>(taps, count, size));
+}
+
+static std::unique_ptr<Fir> fast_complex_fir(float const* taps, std::size_t count,
+                                             std::size_t size) {
+    if (count < 1 || size < 4 || size <= count || !kfr::is_poweroftwo(size))
+        return nullptr;
+
+    return std::unique_ptr<Fir>(new FastFir<Complex, ComplexDft>(taps, count, size));
+}
+
+static std::unique_ptr<Dft> dft(std::size_t size) {
+    if (size < 2 || !kfr::is_poweroftwo(size))
+        return nullptr;
+
+    return std::unique_ptr<Dft>(new ComplexDft(size));
+}
+
+static std::unique_ptr<Dft> real_dft(std::size_t size) {
+    if (size < 4 || !kfr::is_poweroftwo(size))
+        return nullptr;
+
+    return std::unique_ptr<Dft>(new RealDft(size));
+}
+
+Table const& table() {
+    static const Table t = {
+        CMT_STRINGIFY(SDR_KERNEL_ARCH),
+        sine, square, triangle, sawtooth,
+        cexp,
+        { osc_polynomial, osc_lookup, osc_rotation },
+        { complex_osc_polynomial, complex_osc_lookup, complex_osc_rotation },
+        complex_wavetable,
+        chirp, complex_chirp,
+        modulate, complex_modulate,
+        rotate, gaussian,
+        widen, real,
+        compose,
+        multiply, multiply_complex,
+        multiply_accumulate,
+        power, magnitude,
+        accumulate, smooth, maximum, minimum,
+        scale, root, decibels,
+        dot, dot_complex,
+        fir, complex_fir,
+        fast_fir, fast_complex_fir,
+        dft, real_dft,
+    };
+
+    return t;
+}
+
+} /* namespace SDR_KERNEL_ARCH */
+} /* namespace kernels */
+} /* namespace sdr */
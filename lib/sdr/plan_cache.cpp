@@ -0,0 +1,168 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "plan_cache.hpp"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace sdr;
+
+static const char magic[8] = { 's', 'd', 'r', 'f', 'f', 't', '1', '\n' };
+
+struct Header {
+    char magic[8];
+    std::uint64_t size;
+};
+
+static bool make_dirs(std::string const& path) {
+    for (std::size_t pos = 1; pos != std::string::npos; ) {
+        pos = path.find('/', pos + 1);
+        auto dir = path.substr(0, pos);
+
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+            return false;
+    }
+
+    return true;
+}
+
+static std::string cache_dir() {
+    if (auto env = std::getenv("SDR_FFT_CACHE")) {
+        if (!std::strcmp(env, "0"))
+            return std::string();
+        if (*env)
+            return env;
+    }
+
+    if (auto xdg = std::getenv("XDG_CACHE_HOME")) {
+        if (*xdg == '/')
+            return std::string(xdg) + "/sdr/fft";
+    }
+
+    if (auto home = std::getenv("HOME")) {
+        if (*home)
+            return std::string(home) + "/.cache/sdr/fft";
+    }
+
+    return std::string();
+}
+
+static std::string const& directory() {
+    static const std::string dir = cache_dir();
+    return dir;
+}
+
+static bool read_all(int fd, void* data, std::size_t size) {
+    auto ptr = static_cast<char*>(data);
+
+    while (size) {
+        ssize_t count = read(fd, ptr, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        ptr += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, void const* data, std::size_t size) {
+    auto ptr = static_cast<char const*>(data);
+
+    while (size) {
+        ssize_t count = write(fd, ptr, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        ptr += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool PlanCache::enabled() noexcept {
+    return !directory().empty();
+}
+
+bool PlanCache::load(char const* key, void* data, std::size_t size) noexcept {
+    if (!enabled())
+        return false;
+
+    try {
+        auto path = directory() + "/" + key;
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        Header header;
+        bool ok = read_all(fd, &header, sizeof(header)) &&
+                  !std::memcmp(header.magic, magic, sizeof(magic)) &&
+                  header.size == size &&
+                  read_all(fd, data, size);
+
+        close(fd);
+        return ok;
+    } catch (...) {
+        return false;
+    }
+}
+
+void PlanCache::store(char const* key, void const* data, std::size_t size) noexcept {
+    if (!enabled())
+        return;
+
+    try {
+        if (!make_dirs(directory()))
+            return;
+
+        // Write then rename, so concurrent readers never see partial files
+        auto path = directory() + "/" + key;
+        auto temp = path + "." + std::to_string(getpid()) + ".tmp";
+
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return;
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.size = size;
+
+        bool ok = write_all(fd, &header, sizeof(header)) && write_all(fd, data, size);
+        ok = (close(fd) == 0) && ok;
+
+        if (!ok || rename(temp.c_str(), path.c_str()) < 0)
+            unlink(temp.c_str());
+    } catch (...) {
+    }
+}
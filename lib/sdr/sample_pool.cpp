@@ -0,0 +1,317 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sample_pool.hpp"
+#include "spinlock.hpp"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+
+using namespace sdr;
+
+static constexpr std::size_t Alignment = 512;
+static constexpr std::size_t MinShift = 9;          // 512B
+static constexpr std::size_t Classes = 18;          // up to 64MiB
+static constexpr std::size_t MappedShift = 21;      // 2MiB and more are mmapped
+
+static constexpr std::size_t ThreadCacheDepth = 4;
+static constexpr std::size_t SharedDepth = 32;
+
+// Freed mapped blocks stay resident, so their cache is bounded by size
+static constexpr std::size_t SharedMappedBytes = std::size_t(1) << 27;   // 128MiB
+
+enum HugePages {
+    Off,
+    Transparent,    // madvise(MADV_HUGEPAGE)
+    HugeTLB,        // MAP_HUGETLB, falls back to Transparent
+};
+
+static inline std::size_t class_size(std::size_t c) {
+    return std::size_t(1) << (c + MinShift);
+}
+
+static inline bool is_mapped(std::size_t c) {
+    return c + MinShift >= MappedShift;
+}
+
+static inline bool is_mapped_size(std::size_t size) {
+    return size >= (std::size_t(1) << MappedShift);
+}
+
+static inline std::size_t unpooled_size(std::size_t size) {
+    const std::size_t page = std::size_t(1) << MappedShift;
+    return (size + page - 1) & ~(page - 1);
+}
+
+// Smallest class that fits size, Classes if none does
+static inline std::size_t class_of(std::size_t size) {
+    if (size <= Alignment)
+        return 0;
+
+    std::size_t c = (8*sizeof(unsigned long long) - __builtin_clzll(size - 1)) - MinShift;
+    return std::min(c, Classes);
+}
+
+// Freed blocks are linked through their first bytes
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+namespace
+{
+
+struct Pool {
+    Pool() {
+        if (auto env = std::getenv("SDR_HUGEPAGES")) {
+            if (!std::strcmp(env, "thp"))
+                mode = Transparent;
+            else if (!std::strcmp(env, "hugetlb"))
+                mode = HugeTLB;
+        }
+
+        if (std::getenv("SDR_POOL_STATS"))
+            std::atexit([]() { std::cerr << "sample pool: " << SamplePool::stats() << std::endl; });
+    }
+
+    Spinlock locks[Classes];
+    FreeBlock* heads[Classes] = {};
+    std::size_t counts[Classes] = {};
+
+    HugePages mode = Off;
+
+    // Bytes held in the shared lists of mapped classes
+    std::atomic<std::size_t> mapped_cached{0};
+
+    std::atomic<std::uint64_t> allocations{0}, deallocations{0};
+    std::atomic<std::uint64_t> cache_hits{0}, pool_hits{0};
+    std::atomic<std::uint64_t> system_allocations{0}, system_frees{0};
+    std::atomic<std::uint64_t> bytes_in_use{0}, bytes_reserved{0};
+};
+
+// Never destroyed: thread caches may flush into it during exit
+Pool& pool() {
+    static Pool* p = new Pool;
+    return *p;
+}
+
+void* system_allocate(std::size_t size) {
+    auto& p = pool();
+    void* ptr = nullptr;
+
+    if (is_mapped_size(size)) {
+        if (p.mode == HugeTLB) {
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr == MAP_FAILED)
+                ptr = nullptr;
+        }
+
+        if (!ptr) {
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                ptr = nullptr;
+            else if (p.mode != Off)
+                madvise(ptr, size, MADV_HUGEPAGE);
+        }
+    } else {
+        ptr = aligned_alloc(Alignment, size);
+    }
+
+    if (!ptr)
+        throw std::bad_alloc();
+
+    p.system_allocations.fetch_add(1, std::memory_order_relaxed);
+    p.bytes_reserved.fetch_add(size, std::memory_order_relaxed);
+
+    return ptr;
+}
+
+void system_free(void* ptr, std::size_t size) {
+    auto& p = pool();
+
+    if (is_mapped_size(size))
+        munmap(ptr, size);
+    else
+        free(ptr);
+
+    p.system_frees.fetch_add(1, std::memory_order_relaxed);
+    p.bytes_reserved.fetch_sub(size, std::memory_order_relaxed);
+}
+
+// Push to the shared list, or release to the system when it is full
+void shared_push(std::size_t c, void* ptr) {
+    auto& p = pool();
+    const std::size_t size = class_size(c);
+
+    if (is_mapped(c) &&
+        p.mapped_cached.fetch_add(size, std::memory_order_relaxed) + size > SharedMappedBytes) {
+        p.mapped_cached.fetch_sub(size, std::memory_order_relaxed);
+        system_free(ptr, size);
+        return;
+    }
+
+    {
+        std::lock_guard<Spinlock> guard(p.locks[c]);
+        if (is_mapped(c) || p.counts[c] < SharedDepth) {
+            auto block = static_cast<FreeBlock*>(ptr);
+            block->next = p.heads[c];
+            p.heads[c] = block;
+            ++p.counts[c];
+            return;
+        }
+    }
+
+    system_free(ptr, size);
+}
+
+void* shared_pop(std::size_t c) {
+    auto& p = pool();
+    std::lock_guard<Spinlock> guard(p.locks[c]);
+
+    auto block = p.heads[c];
+    if (block) {
+        p.heads[c] = block->next;
+        --p.counts[c];
+
+        if (is_mapped(c))
+            p.mapped_cached.fetch_sub(class_size(c), std::memory_order_relaxed);
+    }
+
+    return block;
+}
+
+// Mapped classes bypass the thread cache to bound per-thread memory
+struct ThreadCache {
+    ~ThreadCache() {
+        flush();
+    }
+
+    void flush() {
+        for (std::size_t c = 0; c < Classes; ++c) {
+            while (counts[c])
+                shared_push(c, blocks[c][--counts[c]]);
+        }
+    }
+
+    void* blocks[Classes][ThreadCacheDepth];
+    std::size_t counts[Classes] = {};
+};
+
+thread_local ThreadCache cache;
+
+} /* namespace */
+
+void* SamplePool::allocate(std::size_t size) {
+    auto& p = pool();
+    const std::size_t c = class_of(size);
+
+    p.allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (c == Classes) {
+        // Too large to be pooled, mapped at its own size in whole huge pages
+        size = unpooled_size(size);
+        p.bytes_in_use.fetch_add(size, std::memory_order_relaxed);
+        return system_allocate(size);
+    }
+
+    const std::size_t bytes = class_size(c);
+    p.bytes_in_use.fetch_add(bytes, std::memory_order_relaxed);
+
+    if (cache.counts[c]) {
+        p.cache_hits.fetch_add(1, std::memory_order_relaxed);
+        return cache.blocks[c][--cache.counts[c]];
+    }
+
+    if (auto ptr = shared_pop(c)) {
+        p.pool_hits.fetch_add(1, std::memory_order_relaxed);
+        return ptr;
+    }
+
+    return system_allocate(bytes);
+}
+
+void SamplePool::deallocate(void* ptr, std::size_t size) noexcept {
+    if (!ptr)
+        return;
+
+    auto& p = pool();
+    const std::size_t c = class_of(size);
+
+    p.deallocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (c == Classes) {
+        size = unpooled_size(size);
+        p.bytes_in_use.fetch_sub(size, std::memory_order_relaxed);
+        system_free(ptr, size);
+        return;
+    }
+
+    p.bytes_in_use.fetch_sub(class_size(c), std::memory_order_relaxed);
+
+    if (!is_mapped(c) && cache.counts[c] < ThreadCacheDepth) {
+        cache.blocks[c][cache.counts[c]++] = ptr;
+        return;
+    }
+
+    shared_push(c, ptr);
+}
+
+SamplePool::Stats SamplePool::stats() noexcept {
+    auto& p = pool();
+
+    return {
+        p.allocations.load(std::memory_order_relaxed),
+        p.deallocations.load(std::memory_order_relaxed),
+        p.cache_hits.load(std::memory_order_relaxed),
+        p.pool_hits.load(std::memory_order_relaxed),
+        p.system_allocations.load(std::memory_order_relaxed),
+        p.system_frees.load(std::memory_order_relaxed),
+        p.bytes_in_use.load(std::memory_order_relaxed),
+        p.bytes_reserved.load(std::memory_order_relaxed),
+    };
+}
+
+void SamplePool::trim() noexcept {
+    cache.flush();
+
+    for (std::size_t c = 0; c < Classes; ++c) {
+        while (auto ptr = shared_pop(c))
+            system_free(ptr, class_size(c));
+    }
+}
+
+std::ostream& sdr::operator<<(std::ostream& stream, SamplePool::Stats const& s) {
+    return stream << "SamplePool::Stats{ "
+                  << "allocations: "        << s.allocations        << ", "
+                  << "deallocations: "      << s.deallocations      << ", "
+                  << "cache_hits: "         << s.cache_hits         << ", "
+                  << "pool_hits: "          << s.pool_hits          << ", "
+                  << "system_allocations: " << s.system_allocations << ", "
+                  << "system_frees: "       << s.system_frees       << ", "
+                  << "bytes_in_use: "       << s.bytes_in_use       << ", "
+                  << "bytes_reserved: "     << s.bytes_reserved
+                  << " }";
+}
@@ -89,6 +89,23 @@ static std::size_t sendfile_all(int src, int dst, std::size_t size) {
     return sent;
 }
 
+static std::size_t vmsplice_all(int dst, std::uint8_t const* data, std::size_t size) {
+    std::size_t spliced = 0;
+
+    ssize_t s = 0;
+
+    do {
+        struct iovec iov = { const_cast<std::uint8_t*>(data + spliced), size - spliced };
+        s = vmsplice(dst, &iov, 1, 0);
+        if (s < 0)
+            break;
+
+        spliced += s;
+    } while (spliced < size && s != 0);
+
+    return spliced;
+}
+
 static bool write_all(int fd, std::uint8_t const* data, std::size_t size) {
     auto p = data, end = data + size;
 
@@ -373,3 +390,21 @@ void Sink::send(Packet pkt, std::uint8_t const* data) {
     if (!fifo)
         fdatasync(fd);
 }
+
+void Sink::send_shared(Packet pkt, std::uint8_t const* data) {
+    if (!fifo || !shared) {
+        send(pkt, data);
+        return;
+    }
+
+    if (!raw)
+        write_all(fd, reinterpret_cast<std::uint8_t*>(&pkt), sizeof(Packet));
+
+    // Sockets and other non-pipes refuse vmsplice, write from then on
+    std::size_t spliced = vmsplice_all(fd, data, pkt.size);
+    if (spliced == 0 && pkt.size && (errno == EBADF || errno == EINVAL))
+        shared = false;
+
+    if (spliced < pkt.size)
+        write_all(fd, data + spliced, pkt.size - spliced);
+}
@@ -0,0 +1,197 @@
+/**
+ * sdr - software-defined radio building blocks for unix pipes
+ * Copyright (C) 2017 Fabio Massaioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread_pool.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace sdr;
+
+// Index of the queue owned by the current thread, NoAffinity outside workers
+static thread_local std::size_t worker_index = NoAffinity;
+static thread_local ThreadPool const* worker_pool = nullptr;
+
+static inline void cpu_relax() {
+    asm volatile ("pause":::"memory");
+}
+
+ThreadPool::ThreadPool(std::size_t threads, bool pin) {
+    if (threads == NoAffinity)
+        threads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+    // At least one queue, so that a pool without workers can hold tasks
+    for (std::size_t i = 0; i < std::max(threads, std::size_t(1)); ++i)
+        queues.emplace_back(new Queue);
+
+    std::vector<int> cpus;
+
+    if (pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set))
+                    cpus.push_back(cpu);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < threads; ++i) {
+        // Leave the first cpu to the thread that created the pool
+        int cpu = cpus.empty() ? -1 : cpus[(i + 1) % cpus.size()];
+        workers.emplace_back(&ThreadPool::work, this, i, cpu);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stop.store(true);
+    }
+
+    wake.notify_all();
+
+    for (auto& w: workers)
+        w.join();
+
+    // Run whatever is left so that no group waits forever
+    while (run_one());
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::push(Task task, std::size_t affinity) {
+    std::size_t index;
+
+    if (affinity != NoAffinity)
+        index = affinity % queues.size();
+    else if (worker_pool == this)
+        index = worker_index;
+    else
+        index = next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    {
+        std::lock_guard<Spinlock> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    pending.fetch_add(1);
+
+    if (sleeping.load()) {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        wake.notify_one();
+    }
+}
+
+bool ThreadPool::run_one() {
+    const std::size_t self = (worker_pool == this) ? worker_index : NoAffinity;
+    const std::size_t count = queues.size();
+
+    Task task;
+    bool found = false;
+
+    // Own queue first (newest task, still warm in cache)
+    if (self != NoAffinity) {
+        std::lock_guard<Spinlock> guard(queues[self]->lock);
+        if (!queues[self]->tasks.empty()) {
+            task = std::move(queues[self]->tasks.back());
+            queues[self]->tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // Steal the oldest task from the other queues
+    const std::size_t start = (self != NoAffinity) ? self + 1 : 0;
+    for (std::size_t i = 0; !found && i < count; ++i) {
+        auto& q = *queues[(start + i) % count];
+
+        if (!q.lock.try_lock())
+            continue;
+
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            found = true;
+        }
+
+        q.lock.unlock();
+    }
+
+    if (!found)
+        return false;
+
+    pending.fetch_sub(1, std::memory_order_relaxed);
+
+    std::exception_ptr error;
+
+    try {
+        task.fn();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    task.group->done(error);
+
+    return true;
+}
+
+void ThreadPool::work(std::size_t index, int cpu) {
+    worker_index = index;
+    worker_pool = this;
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (run_one())
+            continue;
+
+        // Spin for a while before going to sleep, tasks often come in bursts
+        bool idle = true;
+        for (int i = 0; i < 256 && idle; ++i) {
+            cpu_relax();
+            idle = !pending.load(std::memory_order_relaxed);
+        }
+
+        if (!idle)
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_lock);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this]() { return pending.load() || stop.load(); });
+        sleeping.fetch_sub(1);
+    }
+}
+
+void TaskGroup::help() {
+    while (count.load(std::memory_order_acquire)) {
+        if (!pool.run_one()) {
+            cpu_relax();
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,434 @@
+#!/usr/bin/env python3
+#
+# sdr - software-defined radio building blocks for unix pipes
+# Copyright (C) 2017 Fabio Massaioli
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Performance regression gate: runs the benchmark executables and a set of
+# block pipelines several times, then compares median throughput against a
+# stored baseline. Exits with status 1 when a result regresses beyond the
+# threshold and its confidence interval does not overlap the baseline one,
+# or when a result has no baseline entry.
+#
+# Throughputs are absolute, so a baseline only holds for the host it was
+# recorded on: regenerate it with --update on the machine that runs the
+# gate. The baseline records its host, and on any other host results
+# missing from it are reported without failing the gate.
+
+import argparse
+import json
+import math
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_BASELINE = os.path.join(SCRIPT_DIR, '..', 'bench', 'baseline.json')
+
+# Kept short so that a full gate run takes a few minutes
+TRANSPORT_ARGS = [
+    'path=send,pass,copy', 'source=fifo,memfd', 'sink=fifo,memfd,null',
+    'sizes=4096,65536', 'packets=2000',
+]
+
+# Fixed sizes: the default ones follow the host page and pipe sizes, and
+# result names include them
+KERNEL_ARGS = ['repeat=100', 'sizes=1024,2048']
+
+# name, block command line, gen arguments producing its input, sample size
+BLOCKS = [
+    ('channel', ['channel', 'noise=-40', 'offset=100', 'linewidth=10',
+                 'delays=0,3', 'gains=0,-6', 'sample_rate=1000000'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('channelize', ['channelize', 'channels=64'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('decimate', ['decimate', '1000'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('fir/real', ['fir', 'lowpass', 'high=10', 'unit=samples', 'taps=255'],
+     ['1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('fir/complex', ['fir', 'lowpass', 'high=10', 'unit=samples', 'taps=255'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('hilbert/real', ['hilbert'],
+     ['1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('hilbert/complex', ['hilbert'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('hilbert/fs4', ['hilbert', 'mode=fs4'],
+     ['1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('resample/real', ['resample', '160', '147'],
+     ['1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('resample/complex', ['resample', '160', '147'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('spectrum/real', ['spectrum'],
+     ['1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('spectrum/complex', ['spectrum'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('xlate', ['xlate', '100000', 'decimation=8', 'sample_rate=1000000'],
+     ['1000', 'sample_rate=1000000', 'mode=complex'], 8),
+]
+
+# name, source block command line, sample size
+SOURCES = [
+    ('gen/real', ['gen', '1000', 'sample_rate=1000000', 'mode=real'], 4),
+    ('gen/complex', ['gen', '1000', 'sample_rate=1000000', 'mode=complex'], 8),
+    ('multitone', ['multitone', '1000,20000,50000', 'sample_rate=1000000'], 8),
+    ('sweep', ['sweep', 'start=1000', 'stop=100000', 'sweep=sawtooth',
+               'sample_rate=1000000'], 8),
+]
+
+BLOCK_INPUT_SIZE = 32 << 20
+
+
+class Environment:
+    """Pin cpus and disable frequency scaling effects where permitted"""
+
+    GOVERNOR = '/sys/devices/system/cpu/cpu{}/cpufreq/scaling_governor'
+    NO_TURBO = '/sys/devices/system/cpu/intel_pstate/no_turbo'
+    BOOST = '/sys/devices/system/cpu/cpufreq/boost'
+
+    def __init__(self, cpus):
+        self.cpus = cpus
+        self.saved = []
+
+    def _write(self, path, value):
+        try:
+            with open(path) as f:
+                old = f.read().strip()
+            if old == value:
+                return True
+            with open(path, 'w') as f:
+                f.write(value)
+            self.saved.append((path, old))
+            return True
+        except OSError:
+            return False
+
+    def __enter__(self):
+        ok = True
+        for cpu in self.cpus:
+            path = self.GOVERNOR.format(cpu)
+            if os.path.exists(path):
+                ok = self._write(path, 'performance') and ok
+
+        if os.path.exists(self.NO_TURBO):
+            ok = self._write(self.NO_TURBO, '1') and ok
+        elif os.path.exists(self.BOOST):
+            ok = self._write(self.BOOST, '0') and ok
+
+        if not ok:
+            print("warning: perfgate: cannot set cpu governor or turbo state, "
+                  "results may be noisy (run as root)", file=sys.stderr)
+
+        return self
+
+    def __exit__(self, *args):
+        for path, old in reversed(self.saved):
+            try:
+                with open(path, 'w') as f:
+                    f.write(old)
+            except OSError:
+                pass
+
+    def preexec(self):
+        os.sched_setaffinity(0, self.cpus)
+
+
+def median(xs):
+    xs = sorted(xs)
+    n = len(xs)
+    return (xs[(n - 1) // 2] + xs[n // 2]) / 2
+
+
+def median_ci(xs, confidence):
+    """Distribution-free confidence interval for the median (order statistics)"""
+    xs = sorted(xs)
+    n = len(xs)
+    alpha = 1 - confidence
+
+    def cdf(k):
+        return sum(math.comb(n, i) for i in range(k + 1)) / 2**n
+
+    # Widest interval when there are too few runs for the requested level
+    j = 0
+    while j + 1 <= (n - 1) // 2 and 2 * cdf(j + 1) <= alpha:
+        j += 1
+
+    return xs[j], xs[n - 1 - j]
+
+
+def fail(message):
+    print("error: perfgate: " + message, file=sys.stderr)
+    sys.exit(2)
+
+
+def check_exit(cmd, returncode):
+    """A failed run finishes early and would look fast, so it stops the gate"""
+    if returncode < 0:
+        fail("'{}' killed by signal {}".format(' '.join(cmd), -returncode))
+    if returncode != 0:
+        fail("'{}' exited with status {}".format(' '.join(cmd), returncode))
+
+
+def run_benchmark(env, exe, args):
+    cmd = [exe, 'format=json'] + args
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, preexec_fn=env.preexec, check=False)
+    check_exit(cmd, proc.returncode)
+
+    if not proc.stdout.strip():
+        return []
+    return json.loads(proc.stdout)
+
+
+def make_block_input(build_dir, gen_args, path):
+    with open(path, 'wb') as f:
+        gen = subprocess.Popen([os.path.join(build_dir, 'gen')] + gen_args,
+                               stdout=subprocess.PIPE)
+        remaining = BLOCK_INPUT_SIZE
+        while remaining > 0:
+            chunk = gen.stdout.read(min(remaining, 1 << 20))
+            if not chunk:
+                break
+            f.write(chunk)
+            remaining -= len(chunk)
+        gen.kill()
+        gen.wait()
+
+    if remaining > 0:
+        fail("'{}' ended after {} of {} bytes".format(
+            ' '.join(['gen'] + gen_args), BLOCK_INPUT_SIZE - remaining, BLOCK_INPUT_SIZE))
+
+
+def run_block(env, build_dir, cmd, input_path, sample_size):
+    with open(input_path, 'rb') as stdin, open(os.devnull, 'wb') as stdout:
+        start = time.perf_counter()
+        proc = subprocess.run([os.path.join(build_dir, cmd[0])] + cmd[1:],
+                              stdin=stdin, stdout=stdout, preexec_fn=env.preexec, check=False)
+        elapsed = time.perf_counter() - start
+
+    check_exit(cmd, proc.returncode)
+
+    # Packet headers are counted as samples, close enough for comparisons
+    return os.path.getsize(input_path) / sample_size / elapsed
+
+
+def run_source(env, build_dir, cmd, sample_size):
+    """Time a source block producing BLOCK_INPUT_SIZE bytes"""
+    start = time.perf_counter()
+    proc = subprocess.Popen([os.path.join(build_dir, cmd[0])] + cmd[1:],
+                            stdout=subprocess.PIPE, preexec_fn=env.preexec)
+    remaining = BLOCK_INPUT_SIZE
+    while remaining > 0:
+        chunk = proc.stdout.read(min(remaining, 1 << 20))
+        if not chunk:
+            break
+        remaining -= len(chunk)
+    elapsed = time.perf_counter() - start
+
+    if remaining > 0:
+        check_exit(cmd, proc.wait())
+        fail("'{}' ended after {} of {} bytes".format(
+            ' '.join(cmd), BLOCK_INPUT_SIZE - remaining, BLOCK_INPUT_SIZE))
+
+    proc.kill()
+    proc.wait()
+
+    return BLOCK_INPUT_SIZE / sample_size / elapsed
+
+
+def host_id():
+    """Cpu model the results were measured on"""
+    try:
+        with open('/proc/cpuinfo') as f:
+            for line in f:
+                if line.startswith('model name'):
+                    return line.split(':', 1)[1].strip()
+    except OSError:
+        pass
+    return platform.processor() or platform.machine()
+
+
+def collect(args, env):
+    samples = {}
+    units = {}
+
+    def add(name, value, unit):
+        if args.filter and not re.search(args.filter, name):
+            return
+        samples.setdefault(name, []).append(value)
+        units[name] = unit
+
+    benchmarks = []
+    transport = os.path.join(args.build_dir, 'bench', 'bench-transport')
+    if os.path.exists(transport):
+        benchmarks.append((transport, TRANSPORT_ARGS))
+    kernels = os.path.join(args.build_dir, 'bench', 'bench-kernels')
+    if os.path.exists(kernels):
+        benchmarks.append((kernels, KERNEL_ARGS))
+
+    blocks = [b for b in BLOCKS
+              if os.path.exists(os.path.join(args.build_dir, 'blocks', b[1][0]))]
+    sources = [s for s in SOURCES
+               if os.path.exists(os.path.join(args.build_dir, 'blocks', s[1][0]))]
+
+    with tempfile.TemporaryDirectory(prefix='sdr-perfgate-') as tmp:
+        inputs = {}
+        for name, cmd, gen_args, _ in blocks:
+            path = os.path.join(tmp, name.replace('/', '_'))
+            make_block_input(os.path.join(args.build_dir, 'blocks'), gen_args, path)
+            inputs[name] = path
+
+        for run in range(args.warmup_runs + args.runs):
+            warmup = run < args.warmup_runs
+            print("perfgate: {} run {}/{}".format(
+                      "warmup" if warmup else "measurement",
+                      run + 1 if warmup else run - args.warmup_runs + 1,
+                      args.warmup_runs if warmup else args.runs),
+                  file=sys.stderr)
+
+            for exe, bench_args in benchmarks:
+                for result in run_benchmark(env, exe, bench_args):
+                    if not warmup:
+                        add(result['name'], result['throughput'], result['unit'])
+
+            for name, cmd, _, sample_size in blocks:
+                value = run_block(env, os.path.join(args.build_dir, 'blocks'),
+                                  cmd, inputs[name], sample_size)
+                if not warmup:
+                    add('blocks/' + name, value, 'S/s')
+
+            for name, cmd, sample_size in sources:
+                value = run_source(env, os.path.join(args.build_dir, 'blocks'), cmd, sample_size)
+                if not warmup:
+                    add('blocks/' + name, value, 'S/s')
+
+    return {
+        name: {
+            'unit': units[name],
+            'median': median(xs),
+            'ci': list(median_ci(xs, args.confidence)),
+            'runs': len(xs),
+        }
+        for name, xs in samples.items()
+    }
+
+
+def compare(baseline, current, threshold):
+    """Return the number of regressions and of results missing from the baseline"""
+    regressions = 0
+
+    for name in sorted(baseline):
+        base = baseline[name]
+        cur = current.get(name)
+
+        if cur is None:
+            print("warning: perfgate: {}: missing from current results".format(name),
+                  file=sys.stderr)
+            continue
+
+        change = (cur['median'] / base['median'] - 1) if base['median'] else 0.0
+        dropped = change < -threshold
+        significant = cur['ci'][1] < base['ci'][0]
+
+        if dropped and significant:
+            status = 'REGRESSION'
+            regressions += 1
+        elif dropped:
+            status = 'noisy'
+        else:
+            status = 'ok'
+
+        print("{:<48} {:>+8.1f}%  {:>12.4g} -> {:>12.4g} {:<4} {}".format(
+            name, 100 * change, base['median'], cur['median'], cur['unit'], status))
+
+    # Results without a baseline could never be flagged, so on the host of
+    # the baseline they fail too
+    missing = sorted(set(current) - set(baseline))
+    for name in missing:
+        print("{:<48} {:>9}  {:>12} -> {:>12.4g} {:<4} NO BASELINE".format(
+            name, '', '', current[name]['median'], current[name]['unit']))
+
+    return regressions, len(missing)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--build-dir', default='build',
+                        help="meson build directory (default: build)")
+    parser.add_argument('--baseline', default=DEFAULT_BASELINE,
+                        help="baseline file (default: bench/baseline.json)")
+    parser.add_argument('--runs', type=int, default=5,
+                        help="measured runs per benchmark (default: 5)")
+    parser.add_argument('--warmup-runs', type=int, default=1,
+                        help="discarded runs before measuring (default: 1)")
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help="allowed throughput drop in percent (default: 5)")
+    parser.add_argument('--confidence', type=float, default=0.95,
+                        help="confidence level of median intervals (default: 0.95)")
+    parser.add_argument('--cpus', default=None,
+                        help="comma separated cpus to pin benchmarks to "
+                             "(default: last two available)")
+    parser.add_argument('--filter', default=None,
+                        help="only consider results whose name matches this regex")
+    parser.add_argument('--update', action='store_true',
+                        help="write current results to the baseline file and exit")
+    args = parser.parse_args()
+
+    if args.runs < 1:
+        parser.error("--runs must be at least 1")
+
+    if args.cpus:
+        cpus = {int(c) for c in args.cpus.split(',')}
+    else:
+        cpus = set(sorted(os.sched_getaffinity(0))[-2:])
+
+    with Environment(cpus) as env:
+        current = collect(args, env)
+
+    if not current:
+        fail("no benchmark results, is '{}' a build directory?".format(args.build_dir))
+
+    if args.update:
+        with open(args.baseline, 'w') as f:
+            json.dump({ 'host': host_id(), 'results': current }, f, indent=2, sort_keys=True)
+            f.write('\n')
+        sys.exit(0)
+
+    with open(args.baseline) as f:
+        stored = json.load(f)
+
+    baseline = {name: result for name, result in stored['results'].items()
+                if not args.filter or re.search(args.filter, name)}
+
+    # Another machine may lack instruction sets or blocks the baseline has,
+    # and have others it does not
+    foreign = stored.get('host') != host_id()
+    if foreign:
+        print("warning: perfgate: baseline recorded on '{}', this host is '{}'; "
+              "regenerate it with --update".format(stored.get('host'), host_id()),
+              file=sys.stderr)
+
+    regressions, missing = compare(baseline, current, args.threshold / 100)
+
+    if missing:
+        print("{}: perfgate: {} result(s) missing from the baseline, record them with "
+              "--update".format("warning" if foreign else "error", missing), file=sys.stderr)
+    if regressions:
+        print("perfgate: {} regression(s) beyond {}%".format(regressions, args.threshold),
+              file=sys.stderr)
+    if regressions or (missing and not foreign):
+        sys.exit(1)